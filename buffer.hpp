@@ -11,47 +11,204 @@
 #include <condition_variable>
 #include <functional>
 #include <cassert>
+#include <cstdint>
+#include <chrono>
+#include <string_view>
+
+#include "level.hpp"
 
 namespace YLog {
 
 #define BUFFER_DEFAULT_SIZE (1 * 1024 * 1024)
 #define BUFFER_INCREMENT_SIZE (1 * 1024 * 1024)
 #define BUFFER_THRESHOLD_SIZE (10 * 1024 * 1024)
+#define BUFFER_URGENT_SIZE (64 * 1024)
+#define BUFFER_LARGE_SIZE (64 * 1024)       // 超过该长度的单条日志放在缓冲区之外
+
+// 单条日志在缓冲区中的索引. 字节本身仍连续存放, 没有高优先级记录时可整块写出.
+// 超大日志单独分配内存, 缓冲区里只保留索引, 既不阻塞生产者也不撑大缓冲区.
+struct Record {
+    size_t offset;          // 相对缓冲区起始的偏移; 堆外记录为 _external 下标
+    size_t len;
+    uint64_t seq;           // 通道内序号, 用于合并多个通道时保持原始顺序
+    LogLevel::Value level;
+    std::chrono::system_clock::time_point time;     // 入队时间, 多队列按它归并
+    bool external = false;
+    std::string_view logger = {};                   // 记录所属 logger 的名称, 指向进程内常驻的字符串
+    size_t context_offset = 0;                      // 线程上下文(context::Stack::encoded)在 _context 中的位置
+    size_t context_len = 0;
+    size_t level_pos = kNoLevelPos;                 // 等级字段在日志字节中的偏移, 由格式化器给出
+};
 
 class Buffer {
 public:
-    Buffer()
-        : _buffer(BUFFER_DEFAULT_SIZE),
+    Buffer(size_t size = BUFFER_DEFAULT_SIZE)
+        : _buffer(size),
             _read_idx(0),
             _write_idx(0)
     {
     }
 
-    bool empty() { return _read_idx == _write_idx; }
+    bool empty() const { return _read_idx == _write_idx && _external.empty(); }
 
     size_t ReadableSize() { return _write_idx - _read_idx; }
 
     size_t WritableSize() { return _buffer.size() - _write_idx; }
 
-    void reset() { _read_idx = _write_idx = 0; }
+    void reset()
+    {
+        _read_idx = _write_idx = 0;
+        _records.clear();
+        _external.clear();
+        _context.clear();
+    }
 
     void swap(Buffer &other)
     {
         _buffer.swap(other._buffer);
+        _records.swap(other._records);
+        _external.swap(other._external);
+        _context.swap(other._context);
         std::swap(_read_idx, other._read_idx);
         std::swap(_write_idx, other._write_idx);
     }
 
+    // 空间不足时自动扩容, 由调用方决定是否需要先等待可写空间
     void push(const char *data, size_t len)
     {
-        assert(len <= WritableSize());
         EnsureEnoughSpace(len);
-        std::copy(data, data + len, &_buffer[_write_idx]);
+        std::copy(data, data + len, _buffer.data() + _write_idx);
+        _write_idx += len;
+    }
+
+    // 写入一条日志并记录其边界, meta.offset 会被改写为本缓冲区内的偏移
+    void pushRecord(const char *data, const Record &meta, std::string_view context = {})
+    {
+        _records.push_back(meta);
+        _records.back().offset = _write_idx;
+        _records.back().external = false;
+        setContext(_records.back(), context);
+        push(data, meta.len);
+    }
+
+    // 从另一个缓冲区转移一条记录, 堆外记录只移动所有权不拷贝字节
+    void takeRecord(Buffer &src, const Record &meta)
+    {
+        if (!meta.external)
+        {
+            pushRecord(src.data(meta), meta, src.context(meta));
+            return;
+        }
+        _records.push_back(meta);
+        _records.back().offset = _external.size();
+        setContext(_records.back(), src.context(meta));
+        _external.push_back(std::move(src._external[meta.offset]));
+    }
+
+    // 转移 src 中从 first 开始的 count 条记录: 内存上相邻的内联记录一次拷贝, 堆外记录只移动所有权
+    void takeRecords(Buffer &src, size_t first, size_t count)
+    {
+        size_t i = first;
+        size_t end = first + count;
+        while (i < end)
+        {
+            if (src._records[i].external)
+            {
+                takeRecord(src, src._records[i]);
+                ++i;
+                continue;
+            }
+            size_t begin = src._records[i].offset;
+            size_t stop = begin;
+            size_t j = i;
+            while (j < end && !src._records[j].external && src._records[j].offset == stop)
+            {
+                stop += src._records[j].len;
+                ++j;
+            }
+            size_t base = _write_idx;
+            push(src.at(begin), stop - begin);
+            for (; i < j; ++i)
+            {
+                const Record &r = src._records[i];
+                _records.push_back(r);
+                _records.back().offset = base + (r.offset - begin);
+                setContext(_records.back(), src.context(r));
+            }
+        }
+    }
+
+    // 预留至少 len 字节的连续可写区域并返回写入起点, 写完后调用 commitRecord 提交实际长度
+    char *reserve(size_t len)
+    {
+        EnsureEnoughSpace(len);
+        return _buffer.data() + _write_idx;
+    }
+
+    void commitRecord(size_t len, uint64_t seq, LogLevel::Value level,
+                        std::chrono::system_clock::time_point time, std::string_view logger = {},
+                        std::string_view context = {}, size_t level_pos = kNoLevelPos)
+    {
+        assert(len <= WritableSize());
+        _records.push_back(Record{_write_idx, len, seq, level, time, false, logger});
+        _records.back().level_pos = level_pos;
+        setContext(_records.back(), context);
         _write_idx += len;
     }
 
+    // 提交一条已在堆上格式化好的超大日志
+    void commitExternal(std::string &&data, uint64_t seq, LogLevel::Value level,
+                        std::chrono::system_clock::time_point time, std::string_view logger = {},
+                        std::string_view context = {}, size_t level_pos = kNoLevelPos)
+    {
+        _records.push_back(Record{_external.size(), data.size(), seq, level, time, true, logger});
+        _records.back().level_pos = level_pos;
+        setContext(_records.back(), context);
+        _external.push_back(std::move(data));
+    }
+
+    const std::vector<Record> &records() const { return _records; }
+
     const char *begin() { return &_buffer[_read_idx]; }
 
+    const char *at(size_t offset) const { return _buffer.data() + offset; }
+
+    const char *data(const Record &r) const
+    {
+        return r.external ? _external[r.offset].data() : at(r.offset);
+    }
+
+    std::string_view context(const Record &r) const
+    {
+        return std::string_view(_context.data() + r.context_offset, r.context_len);
+    }
+
+    // 按顺序给出连续的字节块: 相邻的内联记录合并成一块, 堆外记录单独一块.
+    // 没有堆外记录时整个缓冲区就是一块.
+    template <typename F>
+    void forEachChunk(F &&f) const
+    {
+        size_t run_begin = _read_idx;
+        if (!_external.empty())
+        {
+            size_t run_end = run_begin;
+            for (auto &r : _records)
+            {
+                if (!r.external)
+                {
+                    run_end = r.offset + r.len;
+                    continue;
+                }
+                if (run_end > run_begin)
+                    f(at(run_begin), run_end - run_begin);
+                f(_external[r.offset].data(), r.len);
+                run_begin = run_end;
+            }
+        }
+        if (_write_idx > run_begin)
+            f(at(run_begin), _write_idx - run_begin);
+    }
+
     void pop()
     {
         _read_idx += ReadableSize();
@@ -59,6 +216,14 @@ public:
     }
 
 protected:
+    // 上下文存放在日志字节之外, 不打断相邻记录的连续字节
+    void setContext(Record &r, std::string_view context)
+    {
+        r.context_offset = _context.size();
+        r.context_len = context.size();
+        _context.append(context.data(), context.size());
+    }
+
     // 确保缓冲区有足够的空间
     void EnsureEnoughSpace(size_t len)
     {
@@ -79,6 +244,9 @@ protected:
 
 private:
     std::vector<char> _buffer;
+    std::vector<Record> _records;
+    std::vector<std::string> _external;
+    std::string _context;           // 各记录的线程上下文首尾相接, 只有需要的 sink 存在时才写入
     size_t _read_idx;
     size_t _write_idx;
 };
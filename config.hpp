@@ -0,0 +1,426 @@
+#ifndef __YLOG_CONFIG_H__
+#define __YLOG_CONFIG_H__
+
+// 配置文件: INI 格式, 每个节是一个 logger, 节名即 logger 名称(支持层级名称).
+//
+//   # 注释以 # 或 ; 开头
+//   [root]
+//   type = async                    ; sync / async
+//   level = info
+//   format = detail                 ; normal / detail / json / logfmt
+//   sinks = file:./logs/app.log, stdout
+//
+//   [db.pool]
+//   pattern = [%Y-%m-%d %H:%M:%S.%e][%n][%l] %v     ; 给出时优先于 format
+//   sinks = roll:./logs/db.log:10485760, daily:./logs/db_
+//   lanes = 4                       ; 仅异步
+//   reopen_on_fork = true           ; 仅异步
+//   repeat_window_ms = 1000
+//
+// sink 写法: stdout | stderr | file:路径 | roll:路径:字节数 | daily:前缀
+
+#include "level.hpp"
+#include "util.hpp"
+#include "sink.hpp"
+#include "loggerFormat.hpp"
+#include "logger.hpp"
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <fstream>
+#include <sstream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <climits>
+#endif
+
+namespace YLog {
+
+struct LoggerConfig {
+    std::string name;
+    Logger::Type type = Logger::Type::LOGGER_SYNC;
+    LogLevel::Value level = LogLevel::Value::DEBUG;
+    std::string format = "normal";
+    std::string pattern;
+    std::vector<std::string> sinks;
+    size_t lanes = 1;
+    bool reopen_on_fork = false;
+    std::chrono::milliseconds repeat_window{0};
+};
+
+class Config {
+public:
+    // 解析整份配置. 任何一处出错都返回 false 并在 err 中给出行号, 此时 out 不应被使用
+    static bool parse(const std::string &text, std::vector<LoggerConfig> &out, std::string &err)
+    {
+        out.clear();
+        std::stringstream ss(text);
+        size_t lineno = 0;
+        for (std::string line; std::getline(ss, line);)
+        {
+            ++lineno;
+            line = util::string::trim(line);
+            if (line.empty() || line[0] == '#' || line[0] == ';')
+            {
+                continue;
+            }
+            if (line.front() == '[')
+            {
+                if (line.back() != ']' || line.size() < 3)
+                {
+                    return fail(err, lineno, "节名格式错误");
+                }
+                out.emplace_back();
+                out.back().name = util::string::trim(line.substr(1, line.size() - 2));
+                continue;
+            }
+            size_t eq = line.find('=');
+            if (eq == std::string::npos)
+            {
+                return fail(err, lineno, "缺少 '='");
+            }
+            if (out.empty())
+            {
+                return fail(err, lineno, "键值出现在任何节之前");
+            }
+            std::string key = util::string::trim(line.substr(0, eq));
+            std::string value = stripComment(util::string::trim(line.substr(eq + 1)), key == "pattern");
+            if (!assign(out.back(), key, value))
+            {
+                return fail(err, lineno, "无法识别 " + key + " = " + value);
+            }
+        }
+        for (auto &c : out)
+        {
+            for (auto &spec : c.sinks)
+            {
+                if (!validSink(spec))
+                {
+                    err = "[" + c.name + "] 无法识别的 sink: " + spec;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    static bool load(const std::string &path, std::vector<LoggerConfig> &out, std::string &err)
+    {
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs.is_open())
+        {
+            err = "无法打开配置文件: " + path;
+            return false;
+        }
+        std::stringstream ss;
+        ss << ifs.rdbuf();
+        return parse(ss.str(), out, err);
+    }
+
+    static LoggerFormat::ptr makeFormat(const LoggerConfig &c)
+    {
+        if (!c.pattern.empty())
+            return std::make_shared<PatternFormat>(c.name, c.pattern);
+        if (c.format == "detail")
+            return std::make_shared<DetailFormat>(c.name);
+        if (c.format == "json")
+            return std::make_shared<JsonFormat>(c.name);
+        if (c.format == "logfmt")
+            return std::make_shared<LogfmtFormat>(c.name);
+        return std::make_shared<NormalFormat>();
+    }
+
+    // sink 写法已在 parse 中校验过
+    static std::vector<LogSink::ptr> makeSinks(const LoggerConfig &c)
+    {
+        std::vector<LogSink::ptr> sinks;
+        for (auto &spec : c.sinks)
+        {
+            std::string kind, arg, extra;
+            split(spec, kind, arg, extra);
+            if (kind == "stdout")
+                sinks.push_back(SinkFactory::create<StdoutSink>());
+            else if (kind == "stderr")
+                sinks.push_back(SinkFactory::create<StderrSink>());
+            else if (kind == "file")
+                sinks.push_back(SinkFactory::create<FileSink>(arg));
+            else if (kind == "roll")
+                sinks.push_back(SinkFactory::create<RollSink>(arg, static_cast<size_t>(std::stoull(extra))));
+            else if (kind == "daily")
+                sinks.push_back(SinkFactory::create<DailyRollSink>(arg));
+        }
+        return sinks;
+    }
+
+private:
+    static bool fail(std::string &err, size_t lineno, const std::string &what)
+    {
+        err = "第 " + std::to_string(lineno) + " 行: " + what;
+        return false;
+    }
+
+    // 行尾注释只认 " ;" / " #", 模式串里的 # ; 原样保留
+    static std::string stripComment(const std::string &value, bool keep)
+    {
+        if (keep)
+            return value;
+        size_t pos = value.find(" ;");
+        pos = std::min(pos, value.find(" #"));
+        return pos == std::string::npos ? value : util::string::trim(value.substr(0, pos));
+    }
+
+    static bool parseBool(const std::string &v, bool &out)
+    {
+        if (v == "true" || v == "on" || v == "1")
+            out = true;
+        else if (v == "false" || v == "off" || v == "0")
+            out = false;
+        else
+            return false;
+        return true;
+    }
+
+    static bool parseNumber(const std::string &v, unsigned long long &out)
+    {
+        if (v.empty() || v.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+        out = std::stoull(v);
+        return true;
+    }
+
+    static bool assign(LoggerConfig &c, const std::string &key, const std::string &value)
+    {
+        unsigned long long n = 0;
+        if (key == "type")
+        {
+            if (value == "sync")
+                c.type = Logger::Type::LOGGER_SYNC;
+            else if (value == "async")
+                c.type = Logger::Type::LOGGER_ASYNC;
+            else
+                return false;
+            return true;
+        }
+        if (key == "level")
+            return LogLevel::fromString(value, c.level);
+        if (key == "format")
+        {
+            c.format = value;
+            return value == "normal" || value == "detail" || value == "json" || value == "logfmt";
+        }
+        if (key == "pattern")
+        {
+            c.pattern = value;
+            return !value.empty();
+        }
+        if (key == "sinks")
+        {
+            c.sinks.clear();
+            std::stringstream ss(value);
+            for (std::string item; std::getline(ss, item, ',');)
+            {
+                item = util::string::trim(item);
+                if (!item.empty())
+                    c.sinks.push_back(item);
+            }
+            return true;
+        }
+        if (key == "lanes")
+        {
+            if (!parseNumber(value, n) || n == 0)
+                return false;
+            c.lanes = static_cast<size_t>(n);
+            return true;
+        }
+        if (key == "reopen_on_fork")
+            return parseBool(value, c.reopen_on_fork);
+        if (key == "repeat_window_ms")
+        {
+            if (!parseNumber(value, n))
+                return false;
+            c.repeat_window = std::chrono::milliseconds(n);
+            return true;
+        }
+        return false;
+    }
+
+    // "roll:./logs/a.log:1024" -> kind, arg, extra; 路径中可以有 ':'(如 Windows 盘符), 字节数取最后一段
+    static void split(const std::string &spec, std::string &kind, std::string &arg, std::string &extra)
+    {
+        size_t pos = spec.find(':');
+        kind = util::string::trim(spec.substr(0, pos));
+        arg = pos == std::string::npos ? std::string() : spec.substr(pos + 1);
+        extra.clear();
+        if (kind == "roll")
+        {
+            size_t last = arg.rfind(':');
+            if (last != std::string::npos)
+            {
+                extra = arg.substr(last + 1);
+                arg = arg.substr(0, last);
+            }
+        }
+    }
+
+    static bool validSink(const std::string &spec)
+    {
+        std::string kind, arg, extra;
+        split(spec, kind, arg, extra);
+        unsigned long long n = 0;
+        if (kind == "stdout" || kind == "stderr")
+            return arg.empty();
+        if (kind == "file" || kind == "daily")
+            return !arg.empty();
+        if (kind == "roll")
+            return !arg.empty() && parseNumber(extra, n) && n > 0;
+        return false;
+    }
+};
+
+// 监视配置文件, 内容变化后调用回调. Linux 上用 inotify 监视所在目录(编辑器常以
+// 写临时文件再改名的方式保存), 其他平台每秒比较一次修改时间. 连续的事件合并为一次回调.
+class ConfigWatcher {
+public:
+    using Callback = std::function<void()>;
+
+    static constexpr int kDebounceMs = 50;
+
+    ConfigWatcher(const std::string &path, const Callback &cb)
+        : _path(path),
+            _callback(cb),
+            _running(true)
+    {
+#ifdef __linux__
+        std::string dir = util::file::path(path);
+        _file = util::file::filename(path);
+        _inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (_inotify_fd >= 0)
+        {
+            _watch = ::inotify_add_watch(_inotify_fd, dir.empty() ? "." : dir.c_str(),
+                                         IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        }
+        if (::pipe(_wake) != 0)
+        {
+            _wake[0] = _wake[1] = -1;
+        }
+#endif
+        _thread = std::thread([this]() { run(); });
+    }
+
+    ~ConfigWatcher()
+    {
+        _running = false;
+#ifdef __linux__
+        if (_wake[1] >= 0)
+        {
+            char c = 0;
+            (void)!::write(_wake[1], &c, 1);
+        }
+#endif
+        if (_thread.joinable())
+        {
+            _thread.join();
+        }
+#ifdef __linux__
+        if (_inotify_fd >= 0)
+            ::close(_inotify_fd);
+        if (_wake[0] >= 0)
+            ::close(_wake[0]);
+        if (_wake[1] >= 0)
+            ::close(_wake[1]);
+#endif
+    }
+
+    bool ok() const
+    {
+#ifdef __linux__
+        return _inotify_fd >= 0 && _watch >= 0 && _wake[0] >= 0;
+#else
+        return true;
+#endif
+    }
+
+private:
+#ifdef __linux__
+    void run()
+    {
+        if (!ok())
+            return;
+        while (_running)
+        {
+            if (waitEvent(-1) && _running)
+            {
+                // 一次保存往往产生多个事件, 等安静下来再重载
+                while (waitEvent(kDebounceMs) && _running)
+                {
+                }
+                if (_running)
+                    _callback();
+            }
+        }
+    }
+
+    // 等待目标文件相关的事件, 超时或被唤醒返回 false
+    bool waitEvent(int timeout_ms)
+    {
+        struct pollfd fds[2] = {{_inotify_fd, POLLIN, 0}, {_wake[0], POLLIN, 0}};
+        if (::poll(fds, 2, timeout_ms) <= 0 || (fds[1].revents & POLLIN))
+            return false;
+
+        alignas(struct inotify_event) char buf[4096];
+        bool hit = false;
+        ssize_t n;
+        while ((n = ::read(_inotify_fd, buf, sizeof(buf))) > 0)
+        {
+            for (char *p = buf; p < buf + n;)
+            {
+                auto *ev = reinterpret_cast<struct inotify_event *>(p);
+                if (ev->len > 0 && _file == ev->name)
+                    hit = true;
+                p += sizeof(struct inotify_event) + ev->len;
+            }
+        }
+        return hit;
+    }
+#else
+    void run()
+    {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        auto last = fs::last_write_time(fs::u8path(_path), ec);
+        while (_running)
+        {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            auto now = fs::last_write_time(fs::u8path(_path), ec);
+            if (!ec && now != last && _running)
+            {
+                last = now;
+                _callback();
+            }
+        }
+    }
+#endif
+
+    std::string _path;
+    Callback _callback;
+    std::atomic<bool> _running;
+#ifdef __linux__
+    std::string _file;
+    int _inotify_fd = -1;
+    int _watch = -1;
+    int _wake[2] = {-1, -1};
+#endif
+    std::thread _thread;
+};
+
+}
+
+#endif // __YLOG_CONFIG_H__
@@ -0,0 +1,181 @@
+#ifndef __YLOG_CONTEXT_H__
+#define __YLOG_CONTEXT_H__
+
+// 线程上下文(MDC): 请求级字段随作用域挂到当前线程, 之后这个线程写的每条日志都带上它们.
+//
+//   YLog::ScopedContext req{"req", request_id};
+//   YLog::ScopedContext tenant{"tenant", name};
+//   logi(logger, "order placed");      // ... [req=42 tenant=acme] order placed
+//
+// 键值在 ScopedContext 构造时格式化成文本, 存进线程本地的一块连续内存; 每次入栈/出栈
+// 改变 version, 格式化器按 version 缓存渲染好的前缀, 上下文不变时每条日志只拷贝一次.
+//
+// 需要按字段取值的 sink(如 RoutingFileSink)不解析格式化后的文本, 而是从记录携带的
+// encoded() 中用 context::find 取原始值, 消息正文的内容不会影响取到的结果.
+
+#include "3rdparty/fmt/core.h"
+#include "3rdparty/fmt/format.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+
+namespace YLog {
+namespace context {
+
+struct Entry {
+    size_t key_pos;
+    size_t key_len;
+    size_t value_pos;
+    size_t value_len;
+};
+
+class Stack {
+public:
+    static Stack &current()
+    {
+        thread_local Stack stack;
+        return stack;
+    }
+
+    template <typename T>
+    size_t push(fmt::string_view key, const T &value)
+    {
+        size_t depth = _entries.size();
+        Entry e;
+        e.key_pos = _arena.size();
+        e.key_len = key.size();
+        _arena.append(key.data(), key.size());
+        e.value_pos = _arena.size();
+        fmt::format_to(std::back_inserter(_arena), "{}", value);
+        e.value_len = _arena.size() - e.value_pos;
+        _entries.push_back(e);
+        ++_version;
+        return depth;
+    }
+
+    // 回到 depth 层, 正常情况下就是弹出最后一项
+    void pop(size_t depth)
+    {
+        if (depth >= _entries.size())
+            return;
+        _arena.resize(_entries[depth].key_pos);
+        _entries.resize(depth);
+        ++_version;
+    }
+
+    bool empty() const { return _entries.empty(); }
+
+    size_t size() const { return _entries.size(); }
+
+    uint64_t version() const { return _version; }
+
+    // 同名的键以内层(后入栈)的为准
+    bool shadowed(size_t i) const
+    {
+        for (size_t j = i + 1; j < _entries.size(); ++j)
+            if (key(j) == key(i))
+                return true;
+        return false;
+    }
+
+    fmt::string_view key(size_t i) const
+    {
+        return fmt::string_view(_arena.data() + _entries[i].key_pos, _entries[i].key_len);
+    }
+
+    fmt::string_view value(size_t i) const
+    {
+        return fmt::string_view(_arena.data() + _entries[i].value_pos, _entries[i].value_len);
+    }
+
+    // 生效的键值(被遮蔽的除外)按 [uint32 键长][键][uint32 值长][值] 依次编码, 按 version 缓存
+    std::string_view encoded()
+    {
+        if (_encoded_version != _version)
+        {
+            _encoded.clear();
+            for (size_t i = 0; i < _entries.size(); ++i)
+            {
+                if (shadowed(i))
+                    continue;
+                appendPart(key(i));
+                appendPart(value(i));
+            }
+            _encoded_version = _version;
+        }
+        return _encoded;
+    }
+
+private:
+    Stack() { _arena.reserve(256); }
+
+    void appendPart(fmt::string_view part)
+    {
+        uint32_t n = static_cast<uint32_t>(part.size());
+        _encoded.append(reinterpret_cast<const char *>(&n), sizeof(n));
+        _encoded.append(part.data(), part.size());
+    }
+
+    std::string _arena;     // 所有键值首尾相接
+    std::vector<Entry> _entries;
+    uint64_t _version = 0;
+    std::string _encoded;
+    uint64_t _encoded_version = 0;
+};
+
+// 在 Stack::encoded() 的结果中查找键, 找到时把原始值(未加引号/转义)写入 value
+inline bool find(std::string_view encoded, std::string_view key, std::string_view &value)
+{
+    auto part = [&](std::string_view &out) {
+        uint32_t n;
+        if (encoded.size() < sizeof(n))
+            return false;
+        std::memcpy(&n, encoded.data(), sizeof(n));
+        if (encoded.size() - sizeof(n) < n)
+            return false;
+        out = encoded.substr(sizeof(n), n);
+        encoded.remove_prefix(sizeof(n) + n);
+        return true;
+    };
+    std::string_view k, v;
+    while (part(k) && part(v))
+    {
+        if (k == key)
+        {
+            value = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+// 作用域内给当前线程的日志附加一个键值, 析构时移除. 值在构造时格式化, 之后修改原变量不影响日志
+class ScopedContext {
+public:
+    template <typename T>
+    ScopedContext(fmt::string_view key, const T &value)
+        : _depth(context::Stack::current().push(key, value))
+    {
+    }
+
+    ~ScopedContext()
+    {
+        context::Stack::current().pop(_depth);
+    }
+
+    ScopedContext(const ScopedContext &) = delete;
+    ScopedContext &operator=(const ScopedContext &) = delete;
+
+private:
+    size_t _depth;
+};
+
+}
+
+#endif // __YLOG_CONTEXT_H__
@@ -1,9 +1,16 @@
 #ifndef __YLOG_LEVEL_H__
 #define __YLOG_LEVEL_H__
 
+#include <string>
+#include <cctype>
+#include <cstddef>
+
 // 日志等级类
 namespace YLog {
 
+// 格式化结果中没有可定位的等级字段(见 LogMsg::level_pos)
+constexpr size_t kNoLevelPos = static_cast<size_t>(-1);
+
 class LogLevel {
 public:
     // 定义日志级别枚举
@@ -31,6 +38,22 @@ public:
         default:                      return "UNKNOWN";
         }
     }
+
+    // 解析等级名称, 不区分大小写, 接受 warning 作为 warn 的别名
+    static bool fromString(const std::string &name, LogLevel::Value &out)
+    {
+        std::string s;
+        for (char c : name)
+            s.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+        if (s == "debug")                          out = Value::DEBUG;
+        else if (s == "info")                      out = Value::INFO;
+        else if (s == "warn" || s == "warning")    out = Value::WARN;
+        else if (s == "error")                     out = Value::ERROR;
+        else if (s == "fatal")                     out = Value::FATAL;
+        else if (s == "off")                       out = Value::OFF;
+        else                                       return false;
+        return true;
+    }
 };
 
 }
@@ -7,6 +7,9 @@
 
 #include <string>
 #include <utility>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 
 namespace YLog {
 // ==================== 便捷函数 ====================
@@ -15,7 +18,7 @@ inline Logger::ptr getLogger(const std::string &name)
     return LoggerMgr::getInstance().getLogger(name);
 }
 
-inline Logger::ptr rootLogger()
+inline const Logger::ptr &rootLogger()
 {
     return LoggerMgr::getInstance().rootLogger();
 }
@@ -25,7 +28,7 @@ inline Logger::ptr rootLogger()
 template <typename... Args>
 void logd(fmt::format_string<Args...> fmt, Args &&...args)
 {
-    auto logger = rootLogger();
+    const Logger::ptr &logger = rootLogger();
     if (logger) {
         logger->debug(fmt, std::forward<Args>(args)...);
     }
@@ -35,7 +38,7 @@ void logd(fmt::format_string<Args...> fmt, Args &&...args)
 template <typename... Args>
 void logi(fmt::format_string<Args...> fmt, Args &&...args)
 {
-    auto logger = rootLogger();
+    const Logger::ptr &logger = rootLogger();
     if (logger) {
         logger->info(fmt, std::forward<Args>(args)...);
     }
@@ -45,7 +48,7 @@ void logi(fmt::format_string<Args...> fmt, Args &&...args)
 template <typename... Args>
 void logw(fmt::format_string<Args...> fmt, Args &&...args)
 {
-    auto logger = rootLogger();
+    const Logger::ptr &logger = rootLogger();
     if (logger) {
         logger->warn(fmt, std::forward<Args>(args)...);
     }
@@ -55,7 +58,7 @@ void logw(fmt::format_string<Args...> fmt, Args &&...args)
 template <typename... Args>
 void loge(fmt::format_string<Args...> fmt, Args &&...args)
 {
-    auto logger = rootLogger();
+    const Logger::ptr &logger = rootLogger();
     if (logger) {
         logger->error(fmt, std::forward<Args>(args)...);
     }
@@ -65,7 +68,7 @@ void loge(fmt::format_string<Args...> fmt, Args &&...args)
 template <typename... Args>
 void logf(fmt::format_string<Args...> fmt, Args &&...args)
 {
-    auto logger = rootLogger();
+    const Logger::ptr &logger = rootLogger();
     if (logger) {
         logger->fatal(fmt, std::forward<Args>(args)...);
     }
@@ -112,8 +115,245 @@ void logf(Logger::ptr logger, fmt::format_string<Args...> fmt, Args &&...args)
     }
 }
 
+// ==================== 结构化日志 ====================
+// logi("order placed", kv("id", id), kv("ms", dur));
+template <typename T, typename... Ts>
+void logd(const char *text, Field<T> field, Field<Ts>... fields)
+{
+    const Logger::ptr &logger = rootLogger();
+    if (logger) {
+        logger->debug(text, field, fields...);
+    }
+}
+
+template <typename T, typename... Ts>
+void logi(const char *text, Field<T> field, Field<Ts>... fields)
+{
+    const Logger::ptr &logger = rootLogger();
+    if (logger) {
+        logger->info(text, field, fields...);
+    }
+}
+
+template <typename T, typename... Ts>
+void logw(const char *text, Field<T> field, Field<Ts>... fields)
+{
+    const Logger::ptr &logger = rootLogger();
+    if (logger) {
+        logger->warn(text, field, fields...);
+    }
+}
+
+template <typename T, typename... Ts>
+void loge(const char *text, Field<T> field, Field<Ts>... fields)
+{
+    const Logger::ptr &logger = rootLogger();
+    if (logger) {
+        logger->error(text, field, fields...);
+    }
 }
 
+template <typename T, typename... Ts>
+void logf(const char *text, Field<T> field, Field<Ts>... fields)
+{
+    const Logger::ptr &logger = rootLogger();
+    if (logger) {
+        logger->fatal(text, field, fields...);
+    }
+}
+
+template <typename T, typename... Ts>
+void logd(Logger::ptr logger, const char *text, Field<T> field, Field<Ts>... fields)
+{
+    if (logger) {
+        logger->debug(text, field, fields...);
+    }
+}
+
+template <typename T, typename... Ts>
+void logi(Logger::ptr logger, const char *text, Field<T> field, Field<Ts>... fields)
+{
+    if (logger) {
+        logger->info(text, field, fields...);
+    }
+}
+
+template <typename T, typename... Ts>
+void logw(Logger::ptr logger, const char *text, Field<T> field, Field<Ts>... fields)
+{
+    if (logger) {
+        logger->warn(text, field, fields...);
+    }
+}
+
+template <typename T, typename... Ts>
+void loge(Logger::ptr logger, const char *text, Field<T> field, Field<Ts>... fields)
+{
+    if (logger) {
+        logger->error(text, field, fields...);
+    }
+}
+
+template <typename T, typename... Ts>
+void logf(Logger::ptr logger, const char *text, Field<T> field, Field<Ts>... fields)
+{
+    if (logger) {
+        logger->fatal(text, field, fields...);
+    }
+}
+
+// ==================== 按调用点限流 / 采样 ====================
+// 每个宏展开处有一份静态的限流状态, 只用 relaxed 原子操作.
+// 被拒绝的调用不求值参数、不格式化; 下一条放行的日志带上 suppressed=N 字段.
+namespace limit {
+
+// 每 n 次放行一次(第 1, n+1, 2n+1 ... 次)
+class EveryN {
+public:
+    explicit EveryN(uint64_t n) : _n(n > 0 ? n : 1) {}
+
+    bool allow(uint64_t &suppressed)
+    {
+        uint64_t c = _count.fetch_add(1, std::memory_order_relaxed);
+        if (c % _n != 0)
+            return false;
+        suppressed = c == 0 ? 0 : _n - 1;
+        return true;
+    }
+
+private:
+    const uint64_t _n;
+    std::atomic<uint64_t> _count{0};
+};
+
+// 每个时间窗口最多放行一次(容量为 1 的令牌桶), 抢到令牌的线程负责报告丢弃数
+class EveryMs {
+public:
+    explicit EveryMs(int64_t ms) : _interval(std::chrono::nanoseconds(std::chrono::milliseconds(ms)).count()) {}
+
+    bool allow(uint64_t &suppressed)
+    {
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t next = _next.load(std::memory_order_relaxed);
+        if (now < next || !_next.compare_exchange_strong(next, now + _interval, std::memory_order_relaxed))
+        {
+            _suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        suppressed = _suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    const int64_t _interval;
+    std::atomic<int64_t> _next{0};
+    std::atomic<uint64_t> _suppressed{0};
+};
+
+// 以概率 p 放行, 随机数来自线程本地的 xorshift, 不共享状态
+class Sampled {
+public:
+    explicit Sampled(double p) : _threshold(threshold(p)) {}
+
+    bool allow(uint64_t &suppressed)
+    {
+        if (next() >= _threshold && _threshold != UINT64_MAX)
+        {
+            _suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        suppressed = _suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    // p * 2^64, p >= 1 时全部放行
+    static uint64_t threshold(double p)
+    {
+        double t = p * 18446744073709551616.0;
+        if (!(t > 0.0))
+            return 0;
+        return t >= 18446744073709551615.0 ? UINT64_MAX : static_cast<uint64_t>(t);
+    }
+
+    static uint64_t next()
+    {
+        thread_local uint64_t state = 0x9e3779b97f4a7c15ULL ^ reinterpret_cast<uintptr_t>(&state);
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    const uint64_t _threshold;
+    std::atomic<uint64_t> _suppressed{0};
+};
+
+}
+
+}
+
+// ==================== 记录调用点的日志宏 ====================
+// 每个展开处有一份编译期生成的静态 SourceLoc (文件名、行号文本、函数名、等级),
+// 模式串用 %s %# %! 输出, JSON/logfmt 输出 src 字段. 等级不够时不求值参数.
+//   YLOG_INFO(logger, "connected to {}", host);
+//   YLOG_WARN(logger, "slow query", kv("ms", ms));
+#define YLOG_SOURCE_LOC(level)                                                              \
+    ::YLog::SourceLoc{__FILE__ + ::YLog::source::baseOffset(__FILE__),                      \
+                      sizeof(__FILE__) - 1 - ::YLog::source::baseOffset(__FILE__),          \
+                      ::YLog::source::LineText<__LINE__>::text.data,                        \
+                      ::YLog::source::LineText<__LINE__>::text.len,                         \
+                      __func__, sizeof(__func__) - 1, level}
+
+#define YLOG_LOG(logger, level, ...)                                                        \
+    do {                                                                                    \
+        static constexpr ::YLog::SourceLoc ylog_loc_ = YLOG_SOURCE_LOC(level);              \
+        auto &&ylog_logger_ = (logger);                                                     \
+        if (ylog_logger_ && ylog_logger_->shouldLog(level))                                 \
+            ylog_logger_->logAt(ylog_loc_, __VA_ARGS__);                                    \
+    } while (0)
+
+#define YLOG_DEBUG(logger, ...) YLOG_LOG(logger, ::YLog::LogLevel::Value::DEBUG, __VA_ARGS__)
+#define YLOG_INFO(logger, ...)  YLOG_LOG(logger, ::YLog::LogLevel::Value::INFO, __VA_ARGS__)
+#define YLOG_WARN(logger, ...)  YLOG_LOG(logger, ::YLog::LogLevel::Value::WARN, __VA_ARGS__)
+#define YLOG_ERROR(logger, ...) YLOG_LOG(logger, ::YLog::LogLevel::Value::ERROR, __VA_ARGS__)
+#define YLOG_FATAL(logger, ...) YLOG_LOG(logger, ::YLog::LogLevel::Value::FATAL, __VA_ARGS__)
+
+// YLOG_LOG_LIMITED(logger, level, limit::EveryN, 100, "fmt", args...)
+// 也可以带结构化字段: YLOG_WARN_EVERY_N(logger, 100, "slow query", kv("ms", ms));
+#define YLOG_LOG_LIMITED(logger, level, Limiter, arg, ...)                                  \
+    do {                                                                                    \
+        static constexpr ::YLog::SourceLoc ylog_loc_ = YLOG_SOURCE_LOC(level);              \
+        static ::YLog::Limiter ylog_limiter_(arg);                                          \
+        auto &&ylog_logger_ = (logger);                                                     \
+        uint64_t ylog_suppressed_ = 0;                                                      \
+        if (ylog_logger_ && ylog_logger_->shouldLog(level) && ylog_limiter_.allow(ylog_suppressed_)) \
+            ylog_logger_->logSuppressed(ylog_loc_, ylog_suppressed_, __VA_ARGS__);          \
+    } while (0)
+
+// 每 n 次输出一次: YLOG_INFO_EVERY_N(logger, 1000, "retry failed: {}", err);
+#define YLOG_DEBUG_EVERY_N(logger, n, ...) YLOG_LOG_LIMITED(logger, ::YLog::LogLevel::Value::DEBUG, limit::EveryN, n, __VA_ARGS__)
+#define YLOG_INFO_EVERY_N(logger, n, ...)  YLOG_LOG_LIMITED(logger, ::YLog::LogLevel::Value::INFO, limit::EveryN, n, __VA_ARGS__)
+#define YLOG_WARN_EVERY_N(logger, n, ...)  YLOG_LOG_LIMITED(logger, ::YLog::LogLevel::Value::WARN, limit::EveryN, n, __VA_ARGS__)
+#define YLOG_ERROR_EVERY_N(logger, n, ...) YLOG_LOG_LIMITED(logger, ::YLog::LogLevel::Value::ERROR, limit::EveryN, n, __VA_ARGS__)
+#define YLOG_FATAL_EVERY_N(logger, n, ...) YLOG_LOG_LIMITED(logger, ::YLog::LogLevel::Value::FATAL, limit::EveryN, n, __VA_ARGS__)
+
+// 每 ms 毫秒最多输出一次: YLOG_ERROR_EVERY_MS(logger, 1000, "db down: {}", err);
+#define YLOG_DEBUG_EVERY_MS(logger, ms, ...) YLOG_LOG_LIMITED(logger, ::YLog::LogLevel::Value::DEBUG, limit::EveryMs, ms, __VA_ARGS__)
+#define YLOG_INFO_EVERY_MS(logger, ms, ...)  YLOG_LOG_LIMITED(logger, ::YLog::LogLevel::Value::INFO, limit::EveryMs, ms, __VA_ARGS__)
+#define YLOG_WARN_EVERY_MS(logger, ms, ...)  YLOG_LOG_LIMITED(logger, ::YLog::LogLevel::Value::WARN, limit::EveryMs, ms, __VA_ARGS__)
+#define YLOG_ERROR_EVERY_MS(logger, ms, ...) YLOG_LOG_LIMITED(logger, ::YLog::LogLevel::Value::ERROR, limit::EveryMs, ms, __VA_ARGS__)
+#define YLOG_FATAL_EVERY_MS(logger, ms, ...) YLOG_LOG_LIMITED(logger, ::YLog::LogLevel::Value::FATAL, limit::EveryMs, ms, __VA_ARGS__)
+
+// 以概率 p 输出: YLOG_DEBUG_SAMPLED(logger, 0.01, "req {}", id);
+#define YLOG_DEBUG_SAMPLED(logger, p, ...) YLOG_LOG_LIMITED(logger, ::YLog::LogLevel::Value::DEBUG, limit::Sampled, p, __VA_ARGS__)
+#define YLOG_INFO_SAMPLED(logger, p, ...)  YLOG_LOG_LIMITED(logger, ::YLog::LogLevel::Value::INFO, limit::Sampled, p, __VA_ARGS__)
+#define YLOG_WARN_SAMPLED(logger, p, ...)  YLOG_LOG_LIMITED(logger, ::YLog::LogLevel::Value::WARN, limit::Sampled, p, __VA_ARGS__)
+#define YLOG_ERROR_SAMPLED(logger, p, ...) YLOG_LOG_LIMITED(logger, ::YLog::LogLevel::Value::ERROR, limit::Sampled, p, __VA_ARGS__)
+#define YLOG_FATAL_SAMPLED(logger, p, ...) YLOG_LOG_LIMITED(logger, ::YLog::LogLevel::Value::FATAL, limit::Sampled, p, __VA_ARGS__)
+
+
 
 #endif 
 
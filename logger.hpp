@@ -9,6 +9,7 @@
 #include "loggerFormat.hpp"
 
 #include <vector>
+#include <deque>
 #include <string>
 #include <memory>
 #include <mutex>
@@ -18,6 +19,10 @@
 #include <unordered_map>
 #include <cstdarg>
 #include <type_traits>
+#include <chrono>
+#include <functional>
+#include <string_view>
+#include <algorithm>
 
 
 namespace YLog {
@@ -35,21 +40,26 @@ public:
             std::vector<LogSink::ptr> &sinks,
             LogLevel::Value level = LogLevel::Value::DEBUG,
             LoggerFormat::ptr format = nullptr)
-        : _format(std::move(format)),
-            _name(name),
+        : _name(name),
+            _record_name(util::string::intern(name)),
             _level(level),
-            _sinks(sinks.begin(), sinks.end())
+            _gate(level)
     {
         // Safety: avoid crashing if caller forgot to set a formatter.
         // Default to NormalFormat.
-        if (!_format)
+        if (!format)
         {
-            _format = std::make_shared<NormalFormat>();
+            format = std::make_shared<NormalFormat>();
         }
+        std::unique_ptr<Output> output(new Output(std::move(format), sinks));
+        _output.store(output.get(), std::memory_order_release);
+        _outputs.push_back(std::move(output));
     }
 
+    virtual ~Logger() {}
+
     std::string loggerName() { return _name; }
-    LogLevel::Value loggerLevel() { return _level; }
+    LogLevel::Value loggerLevel() { return _level.load(std::memory_order_relaxed); }
     
     template<typename... Args>
     void debug(fmt::format_string<Args...> fmt, Args&&... args)
@@ -57,12 +67,9 @@ public:
         if (shouldLog(LogLevel::Value::DEBUG) == false)
             return;
 
-        if (!_format)
-            return;
-
-        auto msg = _format->formatLog(LogLevel::Value::DEBUG, fmt::format(fmt, std::forward<Args>(args)...));
-
-        LogIt(std::move(msg));
+        auto store = fmt::make_format_args(args...);
+        LogMsg msg{LogLevel::Value::DEBUG, {}, fmt.get(), store};
+        submit(msg);
     }
 
     template<typename... Args>
@@ -71,12 +78,9 @@ public:
         if (shouldLog(LogLevel::Value::INFO) == false)
             return;
 
-        if (!_format)
-            return;
-
-        auto msg = _format->formatLog(LogLevel::Value::INFO, fmt::format(fmt, std::forward<Args>(args)...));
-
-        LogIt(std::move(msg));
+        auto store = fmt::make_format_args(args...);
+        LogMsg msg{LogLevel::Value::INFO, {}, fmt.get(), store};
+        submit(msg);
     }
 
     template<typename... Args>
@@ -85,12 +89,9 @@ public:
         if (shouldLog(LogLevel::Value::WARN) == false)
             return;
 
-        if (!_format)
-            return;
-
-        auto msg = _format->formatLog(LogLevel::Value::WARN, fmt::format(fmt, std::forward<Args>(args)...));
-
-        LogIt(std::move(msg));
+        auto store = fmt::make_format_args(args...);
+        LogMsg msg{LogLevel::Value::WARN, {}, fmt.get(), store};
+        submit(msg);
     }
 
     template<typename... Args>
@@ -99,12 +100,9 @@ public:
         if (shouldLog(LogLevel::Value::ERROR) == false)
             return;
 
-        if (!_format)
-            return;
-
-        auto msg = _format->formatLog(LogLevel::Value::ERROR, fmt::format(fmt, std::forward<Args>(args)...));
-
-        LogIt(std::move(msg));
+        auto store = fmt::make_format_args(args...);
+        LogMsg msg{LogLevel::Value::ERROR, {}, fmt.get(), store};
+        submit(msg);
     }
 
     template<typename... Args>
@@ -113,31 +111,444 @@ public:
         if (shouldLog(LogLevel::Value::FATAL) == false)
             return;
 
-        if (!_format)
+        auto store = fmt::make_format_args(args...);
+        LogMsg msg{LogLevel::Value::FATAL, {}, fmt.get(), store};
+        submit(msg);
+    }
+
+    // 结构化日志: logger->info("order placed", kv("id", id), kv("ms", dur));
+    // 消息按原样输出(不解析 {}), 字段由格式化器直接编码.
+    // 字段按值传递, 与 format_string 重载比较时由首参数决定, 避免二义性
+    template<typename T, typename... Ts>
+    void debug(const char *text, Field<T> field, Field<Ts>... fields)
+    {
+        logFields(LogLevel::Value::DEBUG, text, field, fields...);
+    }
+
+    template<typename T, typename... Ts>
+    void info(const char *text, Field<T> field, Field<Ts>... fields)
+    {
+        logFields(LogLevel::Value::INFO, text, field, fields...);
+    }
+
+    template<typename T, typename... Ts>
+    void warn(const char *text, Field<T> field, Field<Ts>... fields)
+    {
+        logFields(LogLevel::Value::WARN, text, field, fields...);
+    }
+
+    template<typename T, typename... Ts>
+    void error(const char *text, Field<T> field, Field<Ts>... fields)
+    {
+        logFields(LogLevel::Value::ERROR, text, field, fields...);
+    }
+
+    template<typename T, typename... Ts>
+    void fatal(const char *text, Field<T> field, Field<Ts>... fields)
+    {
+        logFields(LogLevel::Value::FATAL, text, field, fields...);
+    }
+
+    // 日志宏(YLOG_INFO 等)使用: 带上编译期生成的调用点, 等级取自 loc 且已由调用方检查
+    template<typename... Args>
+    void logAt(const SourceLoc &loc, fmt::format_string<Args...> fmt, Args&&... args)
+    {
+        auto store = fmt::make_format_args(args...);
+        LogMsg msg{loc.level, {}, fmt.get(), store};
+        msg.loc = &loc;
+        submit(msg);
+    }
+
+    template<typename T, typename... Ts>
+    void logAt(const SourceLoc &loc, const char *text, Field<T> field, Field<Ts>... fields)
+    {
+        fmt::string_view keys[] = {field.key, fields.key...};
+        auto values = fmt::make_format_args(field.value, fields.value...);
+        auto store = fmt::make_format_args(text);
+        LogMsg msg{loc.level, {}, "{}", store, keys, values, 1 + sizeof...(Ts)};
+        msg.loc = &loc;
+        submit(msg);
+    }
+
+    // 限流宏(YLOG_INFO_EVERY_N 等)使用: suppressed > 0 时附加 suppressed=N 字段,
+    // 报告该调用点自上一条输出以来被丢弃的条数. 等级已由调用方检查.
+    template<typename... Args>
+    void logSuppressed(const SourceLoc &loc, uint64_t suppressed, fmt::format_string<Args...> fmt, Args&&... args)
+    {
+        static const fmt::string_view kKeys[] = {"suppressed"};
+        auto store = fmt::make_format_args(args...);
+        auto values = fmt::make_format_args(suppressed);
+        LogMsg msg{loc.level, {}, fmt.get(), store, kKeys, values, suppressed > 0 ? size_t(1) : size_t(0)};
+        msg.loc = &loc;
+        submit(msg);
+    }
+
+    // 结构化字段版本: suppressed 排在用户字段之后, 为 0 时不输出
+    template<typename T, typename... Ts>
+    void logSuppressed(const SourceLoc &loc, uint64_t suppressed, const char *text, Field<T> field, Field<Ts>... fields)
+    {
+        fmt::string_view keys[] = {field.key, fields.key..., "suppressed"};
+        auto values = fmt::make_format_args(field.value, fields.value..., suppressed);
+        auto store = fmt::make_format_args(text);
+        LogMsg msg{loc.level, {}, "{}", store, keys, values, 1 + sizeof...(Ts) + (suppressed > 0 ? 1 : 0)};
+        msg.loc = &loc;
+        submit(msg);
+    }
+
+    // 等级由 LoggerMgr 按名称层级写入. _gate 是等级与回溯等级中较低的一个, 两者变化时重新发布,
+    // 被过滤的记录只有一次 relaxed 读和一次比较
+    bool shouldLog(LogLevel::Value level)
+    {
+        return level >= _gate.load(std::memory_order_relaxed);
+    }
+
+    // 回溯: 低于当前等级但不低于 level 的记录不写入 sink, 格式化后保存最近 capacity 条在内存中;
+    // 出现 trigger 及以上等级的记录时, 先按顺序输出保存的记录, 再输出这条. capacity 为 0 时关闭.
+    // 生产环境以 INFO 运行, 出错时仍能看到之前的 DEBUG 上下文
+    void enableBacktrace(size_t capacity, LogLevel::Value level = LogLevel::Value::DEBUG,
+                         LogLevel::Value trigger = LogLevel::Value::ERROR)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (capacity == 0)
+        {
+            _backtrace_level.store(LogLevel::Value::OFF);
+            _backtrace_trigger.store(LogLevel::Value::OFF, std::memory_order_relaxed);
+            publishGate();
             return;
+        }
+        if (!_backtrace_ring)
+        {
+            _backtrace_ring.reset(new Backtrace);
+        }
+        {
+            std::unique_lock<std::mutex> ring_lock(_backtrace_ring->mutex);
+            _backtrace_ring->lines.assign(capacity, Line());
+            _backtrace_ring->next = 0;
+            _backtrace_ring->count = 0;
+        }
+        _backtrace.store(_backtrace_ring.get(), std::memory_order_release);
+        _backtrace_level.store(level);
+        _backtrace_trigger.store(trigger, std::memory_order_relaxed);
+        publishGate();
+    }
 
-        auto msg = _format->formatLog(LogLevel::Value::FATAL, fmt::format(fmt, std::forward<Args>(args)...));
+    void disableBacktrace() { enableBacktrace(0); }
 
-        LogIt(std::move(msg));
+    // 运行期修改等级, 只写一次原子变量, 日志路径不加锁.
+    // 已注册到 LoggerMgr 的 logger 再通知 LoggerMgr 同步到继承它的后代; 未注册的不会创建 LoggerMgr
+    void setLevel(LogLevel::Value level)
+    {
+        storeLevel(level);
+        if (_registered.load(std::memory_order_acquire))
+        {
+            if (LevelHook hook = levelHook().load(std::memory_order_acquire))
+            {
+                hook(*this, level);
+            }
+        }
     }
 
+    // 连续重复日志折叠的时间窗口, 0 表示关闭. 需在开始写日志之前设置
+    void setRepeatWindow(std::chrono::milliseconds window) { _repeat_window = window; }
+
 protected:
-    bool shouldLog(LogLevel::Value level) { return level >= _level; }
+    // 连续重复日志折叠: 同一 logger 在窗口内连续输出相同的日志(忽略时间)时只保留第一条,
+    // 其余计数, 遇到不同的日志或超出窗口时补一条 "last message repeated N times" 汇总.
+    // 调用方负责串行化: 同步路径持 _mutex, 异步路径在后台线程.
+    struct RepeatState {
+        bool valid = false;
+        size_t hash = 0;
+        LogLevel::Value level = LogLevel::Value::DEBUG;
+        std::string_view logger;
+        std::string context;
+        std::string body;
+        std::chrono::system_clock::time_point first;
+        std::chrono::system_clock::time_point last;
+        uint64_t count = 0;
+    };
+
+    // 返回 false 表示该条与上一条重复, 已计入汇总, 不应输出
+    template <typename Emit>
+    bool filterRepeat(LogLevel::Value level, std::string_view logger, std::string_view context,
+                        const char *line, size_t len, std::chrono::system_clock::time_point time, Emit &&emit)
+    {
+        if (_repeat_window.count() <= 0)
+            return true;
+
+        fmt::string_view body = output().format->repeatKey(line, len);
+        std::string_view key(body.data(), body.size());
+        size_t hash = std::hash<std::string_view>()(key);
+        if (_repeat.valid && hash == _repeat.hash && level == _repeat.level
+            && time - _repeat.first < _repeat_window && key == _repeat.body)
+        {
+            ++_repeat.count;
+            _repeat.last = time;
+            return false;
+        }
+
+        flushRepeat(emit);
+        _repeat.valid = true;
+        _repeat.hash = hash;
+        _repeat.level = level;
+        _repeat.logger = logger;
+        _repeat.context.assign(context.data(), context.size());
+        _repeat.body.assign(key.data(), key.size());
+        _repeat.first = time;
+        _repeat.last = time;
+        return true;
+    }
+
+    // 有未输出的重复计数时格式化一条汇总交给 emit(RecordView)
+    template <typename Emit>
+    void flushRepeat(Emit &&emit)
+    {
+        if (_repeat.count == 0)
+            return;
+
+        uint64_t count = _repeat.count;
+        long long span = std::chrono::duration_cast<std::chrono::milliseconds>(_repeat.last - _repeat.first).count();
+        _repeat.count = 0;
+
+        thread_local std::vector<char> buf(256);
+        auto store = fmt::make_format_args(count, span);
+        LogMsg msg{_repeat.level, _repeat.last, "last message repeated {} times over {}ms", store};
+        LoggerFormat &format = *output().format;
+        size_t n = format.formatTo(buf.data(), buf.size(), msg);
+        if (n > buf.size())
+        {
+            buf.resize(n);
+            n = format.formatTo(buf.data(), buf.size(), msg);
+        }
+        emit(RecordView{msg.level, msg.time, _repeat.logger, buf.data(), n, _repeat.context, msg.level_pos});
+    }
+
+
+    template<typename... Ts>
+    void logFields(LogLevel::Value level, fmt::string_view text, const Field<Ts> &...fields)
+    {
+        if (shouldLog(level) == false)
+            return;
+
+        fmt::string_view keys[] = {fields.key...};
+        auto values = fmt::make_format_args(fields.value...);
+        auto store = fmt::make_format_args(text);
+        LogMsg msg{level, {}, "{}", store, keys, values, sizeof...(Ts)};
+        submit(msg);
+    }
+
+    // 用户参数以类型擦除的 format_args 放在 msg 中, 由具体 logger 决定格式化到哪里
+    virtual void LogIt(LogMsg &msg) = 0;
 
-    virtual void LogIt(const std::string &msg) = 0;
+    // 子 logger 把记录交给祖先输出
+    static void forward(Logger &to, LogMsg &msg) { to.LogIt(msg); }
+
+    // 输出已格式化好的一行(回溯记录), 不经过等级判断与格式化.
+    // level/level_pos 是这条记录自己的等级与等级字段偏移, trigger 是触发回溯的记录的等级
+    virtual void LogRaw(LogLevel::Value trigger, LogLevel::Value level, const char *data, size_t len,
+                        size_t level_pos) = 0;
+
+    static void forwardRaw(Logger &to, LogLevel::Value trigger, LogLevel::Value level, const char *data,
+                           size_t len, size_t level_pos)
+    {
+        to.LogRaw(trigger, level, data, len, level_pos);
+    }
+
+    // 格式化这个 logger 的记录所用的格式化器; 子 logger 用祖先的, 并在 msg 中带上自己的名称
+    virtual LoggerFormat &recordFormat(LogMsg &) { return *output().format; }
+
+    static LoggerFormat &forwardFormat(Logger &to, LogMsg &msg) { return to.recordFormat(msg); }
+
+    // 所有日志入口在通过 shouldLog 后调用: 低于等级的(只可能是回溯范围内的)记录进入回溯,
+    // 达到触发等级的记录先带出回溯中的记录.
+    // 整个调用期间持有纪元, 其中用到的输出快照(可能在 pushWith 中等待很久)不会被回收
+    void submit(LogMsg &msg)
+    {
+        util::epoch::Guard guard;
+        if (msg.level < _level.load(std::memory_order_relaxed))
+        {
+            keepBacktrace(msg);
+            return;
+        }
+        if (msg.level >= _backtrace_trigger.load(std::memory_order_relaxed))
+        {
+            dumpBacktrace(msg.level);
+        }
+        LogIt(msg);
+    }
+
+    // 回溯: 最近 capacity 条记录的环形缓冲, 每格的 std::string 复用容量, 稳定后不再分配
+    struct Line {
+        std::string text;
+        LogLevel::Value level = LogLevel::Value::DEBUG;
+        size_t level_pos = kNoLevelPos;
+    };
+
+    struct Backtrace {
+        std::mutex mutex;
+        std::vector<Line> lines;
+        size_t next = 0;
+        size_t count = 0;
+    };
+
+    void keepBacktrace(LogMsg &msg)
+    {
+        Backtrace *bt = _backtrace.load(std::memory_order_acquire);
+        if (!bt)
+            return;
+
+        thread_local std::vector<char> buf(256);
+        msg.time = std::chrono::system_clock::now();
+        LoggerFormat &format = recordFormat(msg);
+        size_t len = format.formatTo(buf.data(), buf.size(), msg);
+        if (len > buf.size())
+        {
+            buf.resize(len);
+            len = format.formatTo(buf.data(), buf.size(), msg);
+        }
+
+        std::unique_lock<std::mutex> lock(bt->mutex);
+        if (bt->lines.empty())
+            return;
+        Line &line = bt->lines[bt->next];
+        line.text.assign(buf.data(), len);
+        line.level = msg.level;
+        line.level_pos = msg.level_pos;
+        bt->next = (bt->next + 1) % bt->lines.size();
+        bt->count = std::min(bt->count + 1, bt->lines.size());
+    }
+
+    // 按时间顺序输出并清空回溯, 每条带着自己的等级. 异步队列中按触发记录的等级选通道,
+    // 保证排在触发记录之前.
+    // 持环形缓冲锁时只把内容换到本线程的数组(交换 string, 双方都保留容量), 解锁后再 LogRaw:
+    // 同步 logger 的 LogRaw 要取 _mutex, 而 enableBacktrace 持 _mutex 取环形缓冲锁
+    void dumpBacktrace(LogLevel::Value trigger)
+    {
+        Backtrace *bt = _backtrace.load(std::memory_order_acquire);
+        if (!bt)
+            return;
+
+        thread_local std::vector<Line> lines;
+        size_t count = 0;
+        {
+            std::unique_lock<std::mutex> lock(bt->mutex);
+            size_t size = bt->lines.size();
+            count = bt->count;
+            if (lines.size() < count)
+                lines.resize(count);
+            for (size_t i = 0; i < count; ++i)
+                std::swap(lines[i], bt->lines[(bt->next + size - count + i) % size]);
+            bt->count = 0;
+        }
+        for (size_t i = 0; i < count; ++i)
+            LogRaw(trigger, lines[i].level, lines[i].text.data(), lines[i].text.size(), lines[i].level_pos);
+    }
+
+    // 输出配置快照: 格式化器 + sink. 发布后只读, 热重载时整体替换(RCU 风格):
+    // 读者在 util::epoch::Guard 内无锁地取当前指针(日志入口见 submit, 异步后台线程见 realLog);
+    // 被替换的快照记下纪元, 等到没有读者还停留在该纪元之后的发布中回收,
+    // 仍在用旧格式化器的生产者(包括在队列满时等待的)不受影响.
+    // 旧 sink 在确定无人再写之后(同步: 持锁替换时; 异步: 后台线程切换时)刷新并释放.
+    struct Output {
+        Output(LoggerFormat::ptr f, std::vector<LogSink::ptr> s)
+            : format(std::move(f)), sinks(std::move(s))
+        {
+            for (auto &it : sinks)
+                context = context || it->wantsContext();
+        }
+
+        LoggerFormat::ptr format;
+        std::vector<LogSink::ptr> sinks;
+        bool context = false;   // 有 sink 需要记录携带线程上下文
+        uint64_t retired = 0;   // 被替换时的纪元, 0 表示仍是当前快照
+    };
+
+    // 需要时取当前线程的上下文编码, 随记录交给 sink
+    std::string_view recordContext() const
+    {
+        return output().context ? context::Stack::current().encoded() : std::string_view();
+    }
+
+    // 须在 util::epoch::Guard 内调用(同步 logger 持 _mutex 时除外)
+    Output &output() const { return *_output.load(); }
+
+    // 发布新快照, 需持有 _mutex, 返回被替换的快照(调用方仍可使用, 本次不回收).
+    // 顺带回收已没有读者的旧快照; 异步 logger 后台线程尚未切换走的快照(_pinned)不回收
+    Output *publish(LoggerFormat::ptr format, std::vector<LogSink::ptr> sinks)
+    {
+        if (!format)
+        {
+            format = std::make_shared<NormalFormat>();
+        }
+        Output *old = _output.load(std::memory_order_relaxed);
+        std::unique_ptr<Output> output(new Output(std::move(format), std::move(sinks)));
+        _output.store(output.get());
+        _outputs.push_back(std::move(output));
+        old->retired = util::epoch::advance();
+
+        Output *pinned = _pinned.load(std::memory_order_acquire);
+        _outputs.erase(std::remove_if(_outputs.begin(), _outputs.end(), [&](const std::unique_ptr<Output> &o) {
+            return o->retired != 0 && o.get() != old && o.get() != pinned && util::epoch::idle(o->retired);
+        }), _outputs.end());
+        return old;
+    }
+
+    // LoggerMgr 构造时登记, 析构时清空
+    using LevelHook = void (*)(Logger &, LogLevel::Value);
+
+    static std::atomic<LevelHook> &levelHook()
+    {
+        static std::atomic<LevelHook> hook{nullptr};
+        return hook;
+    }
+
+    friend class LoggerMgr;
+
+public:
+    // 热替换格式化器与 sink, 不阻塞生产者, 已入队的日志不丢失
+    virtual void reconfigure(LoggerFormat::ptr format, std::vector<LogSink::ptr> sinks) = 0;
 
 protected:
-    LoggerFormat::ptr _format;
+    void storeLevel(LogLevel::Value level)
+    {
+        _level.store(level);
+        publishGate();
+    }
+
+    // 等级与回溯等级可能由不同线程同时修改: 先写各自的值再按最新的两者重算 _gate,
+    // CAS 失败说明别人刚发布过, 重读后再算, 最后留下的总是按最新值算出的结果
+    void publishGate()
+    {
+        LogLevel::Value gate = _gate.load();
+        LogLevel::Value want;
+        do
+        {
+            want = std::min(_level.load(), _backtrace_level.load());
+        } while (!_gate.compare_exchange_weak(gate, want));
+    }
+
     std::mutex _mutex;
     std::string _name;
+    std::string_view _record_name;      // 随记录交给 sink 的名称, 常驻内存
     std::atomic<LogLevel::Value> _level;
-    std::vector<LogSink::ptr> _sinks;
+    std::atomic<LogLevel::Value> _gate;     // min(_level, _backtrace_level), shouldLog 只读它
+    std::atomic<bool> _registered{false};   // 已加入 LoggerMgr, 由 LoggerMgr 设置
+    std::atomic<Output *> _output{nullptr};
+    std::vector<std::unique_ptr<Output>> _outputs;  // 当前及尚未回收的旧快照, 受 _mutex 保护
+    std::atomic<Output *> _pinned{nullptr};         // 异步 logger 后台线程正在使用的快照
+    std::chrono::milliseconds _repeat_window{0};
+    RepeatState _repeat;
+    std::atomic<LogLevel::Value> _backtrace_level{LogLevel::Value::OFF};    // OFF 表示未开启
+    std::atomic<LogLevel::Value> _backtrace_trigger{LogLevel::Value::OFF};
+    std::atomic<Backtrace *> _backtrace{nullptr};
+    std::unique_ptr<Backtrace> _backtrace_ring;     // 开启后一直保留, 受 _mutex 保护
     
 };
 
 class SyncLogger : public Logger {
 public:
     using ptr = std::shared_ptr<SyncLogger>;
+
+    static constexpr size_t kInitialLineSize = 1024;
     SyncLogger(const std::string &name,
                 std::vector<LogSink::ptr> &sinks,
                 LogLevel::Value level = LogLevel::Value::DEBUG,
@@ -147,63 +558,298 @@ public:
         std::cout << LogLevel::toString(level) << " 同步⽇志器: " << name << "创建成功...\n";
     }
 
+    ~SyncLogger()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        flushRepeat([this](const RecordView &rec) { writeSinks(rec); });
+    }
+
 private:
-    virtual void LogIt(const std::string &msg)
+    virtual void LogIt(LogMsg &msg)
     {
+        // 格式化到线程本地的可复用缓冲区, 不为每条日志分配 std::string
+        thread_local std::vector<char> buf(kInitialLineSize);
+        msg.time = std::chrono::system_clock::now();
+        LoggerFormat &format = *output().format;
+        size_t len = format.formatTo(buf.data(), buf.size(), msg);
+        if (len > buf.size())
+        {
+            buf.resize(len);
+            len = format.formatTo(buf.data(), buf.size(), msg);
+        }
+
+        // sink 以持锁后读到的快照为准; 格式化期间发生替换时, 这条按旧格式写入新 sink
         std::unique_lock<std::mutex> lock(_mutex);
-        if (_sinks.empty())
+        auto emit = [this](const RecordView &rec) { writeSinks(rec); };
+        std::string_view logger = msg.logger.size() ? std::string_view(msg.logger.data(), msg.logger.size()) : _record_name;
+        std::string_view ctx = recordContext();
+        if (!filterRepeat(msg.level, logger, ctx, buf.data(), len, msg.time, emit))
         {
             return;
         }
-        for (auto &it : _sinks)
+        emit(RecordView{msg.level, msg.time, logger, buf.data(), len, ctx, msg.level_pos});
+    }
+
+    // 同步路径每次只有一条记录, 直接按条交给 sink
+    void writeSinks(const RecordView &rec)
+    {
+        for (auto &it : output().sinks)
         {
-            it->log(msg.c_str(), msg.size());
+            it->logRecord(rec);
         }
     }
+
+    void LogRaw(LogLevel::Value, LogLevel::Value level, const char *data, size_t len, size_t level_pos) override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        flushRepeat([this](const RecordView &rec) { writeSinks(rec); });
+        writeSinks(RecordView{level, std::chrono::system_clock::now(), _record_name, data, len, {}, level_pos});
+    }
+
+public:
+    // 同步路径的 sink 只在 _mutex 内使用, 持锁替换后旧 sink 即可释放
+    void reconfigure(LoggerFormat::ptr format, std::vector<LogSink::ptr> sinks) override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        flushRepeat([this](const RecordView &rec) { writeSinks(rec); });
+        Output *old = publish(std::move(format), std::move(sinks));
+        for (auto &it : old->sinks)
+        {
+            it->flush();
+        }
+        old->sinks.clear();
+    }
 };
 
 class AsyncLogger : public Logger {
 public:
     using ptr = std::shared_ptr<AsyncLogger>;
 
+    // 预估单条日志长度时在格式串长度之上追加的余量
+    static constexpr size_t kEstimatePadding = 128;
+
     AsyncLogger(const std::string &name,
                 std::vector<LogSink::ptr> &sinks,
                 LogLevel::Value level = LogLevel::Value::DEBUG,
-                LoggerFormat::ptr format = nullptr)
+                LoggerFormat::ptr format = nullptr,
+                size_t lanes = 1,
+                bool reopen_on_fork = false)
         : Logger(name, sinks, level, std::move(format)),
-            _looper(std::make_shared<AsyncWorker>([this](Buffer &msg){ this->realLog(msg); }))
+            _active(&output()),
+            _looper(std::make_shared<AsyncWorker>([this](Buffer &msg){ this->realLog(msg); }, lanes))
     {
+        _pinned.store(_active, std::memory_order_release);
+        // fork 后子进程按需重新打开文件, 不与父进程共享同一个文件句柄
+        if (reopen_on_fork)
+        {
+            _looper->onForkChild([this]() {
+                for (auto &it : output().sinks)
+                {
+                    it->reopen();
+                }
+            });
+        }
+
         std::cout << LogLevel::toString(level) << "异步⽇志器: " << name << "创建成功...\n ";
     }
 
+    ~AsyncLogger()
+    {
+        // 先排空队列, 再补上最后一段重复汇总
+        _looper.reset();
+        switchOutput();
+        flushRepeat([this](const RecordView &rec) { writeRecord(rec); });
+        for (auto &it : _active->sinks)
+        {
+            it->flush();
+        }
+    }
+
+    // 异步路径的 sink 只由后台线程使用: 这里只发布新快照, 后台线程处理下一批日志前切换,
+    // 队列中尚未输出的日志(包括替换前入队的)写入新 sink, 生产者不等待
+    void reconfigure(LoggerFormat::ptr format, std::vector<LogSink::ptr> sinks) override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        publish(std::move(format), std::move(sinks));
+    }
+
 protected:
-    virtual void LogIt(const std::string &msg)
+    // 直接格式化进异步队列内存, 省去中间 std::string
+    virtual void LogIt(LogMsg &msg)
+    {
+        LoggerFormat &format = *output().format;
+        std::string_view logger = msg.logger.size() ? std::string_view(msg.logger.data(), msg.logger.size()) : _record_name;
+        _looper->pushWith(msg.level, logger, msg.fmt.size() + kEstimatePadding,
+            [&](char *out, size_t cap, std::chrono::system_clock::time_point time) {
+                msg.time = time;
+                return format.formatTo(out, cap, msg);
+            }, recordContext(), &msg.level_pos);
+    }
+
+    void LogRaw(LogLevel::Value trigger, LogLevel::Value level, const char *data, size_t len,
+                size_t level_pos) override
     {
-        _looper->push(msg);
+        _looper->pushVia(trigger, level, _record_name, len, [&](char *out, size_t cap, std::chrono::system_clock::time_point) {
+            std::memcpy(out, data, std::min(len, cap));
+            return len;
+        }, {}, &level_pos);
+    }
+
+    // 后台线程: 发现新快照时刷新并释放旧 sink
+    void switchOutput()
+    {
+        Output *cur = &output();
+        if (cur == _active)
+        {
+            return;
+        }
+        for (auto &it : _active->sinks)
+        {
+            it->flush();
+        }
+        _active->sinks.clear();
+        _active = cur;
+        _pinned.store(cur, std::memory_order_release);
     }
     
     void realLog(Buffer &msg)
     {
-        if (_sinks.empty())
+        // 切换快照与重复折叠(repeatKey)读当前快照
+        util::epoch::Guard guard;
+        switchOutput();
+        if (_active->sinks.empty())
         {
             return;
         }
-        for (auto &it : _sinks)
+        _views.clear();
+        _summaries.clear();
+        if (_repeat_window.count() > 0)
+        {
+            collectFiltered(msg);
+        }
+        else
+        {
+            for (const Record &rec : msg.records())
+            {
+                _views.push_back(RecordView{rec.level, rec.time, rec.logger, msg.data(rec), rec.len,
+                                            msg.context(rec), rec.level_pos});
+            }
+        }
+
+        // 整批交给每个 sink, 旧接口的 sink 由 LogSink::logBatch 转成逐条或整段调用
+        _iov.resize(_views.size());
+        size_t bytes = 0;
+        for (size_t i = 0; i < _views.size(); ++i)
+        {
+            _iov[i].iov_base = const_cast<char *>(_views[i].data);
+            _iov[i].iov_len = _views[i].len;
+            bytes += _views[i].len;
+        }
+        RecordBatch batch{_views.data(), _iov.data(), _views.size(), bytes};
+        for (auto &it : _active->sinks)
         {
-            it->log(msg.begin(), msg.ReadableSize());
+            it->deliverBatch(batch);
         }
 
         // Batch flush: flush once per drained buffer, not per log line.
-        for (auto &it : _sinks)
+        for (auto &it : _active->sinks)
         {
             it->flush();
         }
     }
 
+    // 一条记录交给所有 sink(析构时补上的重复汇总)
+    void writeRecord(const RecordView &rec)
+    {
+        for (auto &it : _active->sinks)
+        {
+            it->logRecord(rec);
+        }
+    }
+
+    // 开启重复折叠时逐条判断, 保留下来的记录与汇总按顺序放进本批;
+    // 汇总在线程本地缓冲中格式化, 连同上下文先拷进 _summaries(deque 追加不移动已有元素)
+    void collectFiltered(Buffer &msg)
+    {
+        auto emit = [this](const RecordView &view) {
+            RecordView copy = view;
+            _summaries.emplace_back(view.data, view.len);
+            copy.data = _summaries.back().data();
+            _summaries.emplace_back(view.context);
+            copy.context = _summaries.back();
+            _views.push_back(copy);
+        };
+
+        for (const Record &rec : msg.records())
+        {
+            const char *data = msg.data(rec);
+            if (filterRepeat(rec.level, rec.logger, msg.context(rec), data, rec.len, rec.time, emit))
+            {
+                _views.push_back(RecordView{rec.level, rec.time, rec.logger, data, rec.len,
+                                            msg.context(rec), rec.level_pos});
+            }
+        }
+
+        // 重复持续超过窗口而迟迟没有新日志时, 不把汇总一直压着
+        if (_repeat.count > 0 && std::chrono::system_clock::now() - _repeat.first >= _repeat_window)
+        {
+            flushRepeat(emit);
+        }
+    }
+
 protected:
+    Output *_active;    // 后台线程当前使用的快照
+    // 以下只由后台线程使用, 每批复用
+    std::vector<RecordView> _views;
+    std::vector<IoSlice> _iov;
+    std::deque<std::string> _summaries;
     AsyncWorker::ptr _looper;
 };
 
+// 层级名称(如 "db.pool.conn")在首次查找时按需创建的 logger. 自身不持有 sink,
+// 记录带上自己的名称后交给最近的已配置祖先, 由祖先的格式化器和 sink 输出.
+// 祖先与等级都由 LoggerMgr 维护; 祖先只会被替换为更近的已配置 logger, 旧的仍由 LoggerMgr 持有.
+class ChildLogger : public Logger {
+public:
+    using ptr = std::shared_ptr<ChildLogger>;
+
+    ChildLogger(const std::string &name, std::vector<LogSink::ptr> &sinks,
+                LogLevel::Value level, const Logger::ptr &parent)
+        : Logger(name, sinks, level),
+            _parent(parent.get())
+    {
+    }
+
+    Logger *parent() const { return _parent.load(std::memory_order_acquire); }
+
+    void setParent(const Logger::ptr &parent) { _parent.store(parent.get(), std::memory_order_release); }
+
+    // 子 logger 没有自己的输出, 输出由祖先决定; 需要独立输出时改为注册一个已配置的 logger
+    void reconfigure(LoggerFormat::ptr, std::vector<LogSink::ptr>) override {}
+
+protected:
+    void LogIt(LogMsg &msg) override
+    {
+        msg.logger = fmt::string_view(_record_name.data(), _record_name.size());
+        forward(*parent(), msg);
+    }
+
+    void LogRaw(LogLevel::Value trigger, LogLevel::Value level, const char *data, size_t len,
+                size_t level_pos) override
+    {
+        forwardRaw(*parent(), trigger, level, data, len, level_pos);
+    }
+
+    LoggerFormat &recordFormat(LogMsg &msg) override
+    {
+        msg.logger = fmt::string_view(_record_name.data(), _record_name.size());
+        return forwardFormat(*parent(), msg);
+    }
+
+private:
+    std::atomic<Logger *> _parent;
+};
+
 }
 
 #endif
\ No newline at end of file
@@ -6,18 +6,466 @@
 #include "3rdparty/fmt/chrono.h"
 
 #include "level.hpp"
+#include "util.hpp"
+#include "simd.hpp"
+#include "context.hpp"
 #include <memory>
 #include <chrono>
 #include <ctime>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <array>
+#include <vector>
 
 namespace YLog {
 
+// 调用点描述: 由日志宏在编译期生成并放在静态存储里, 记录只带一个指针.
+// 文件名已去掉目录, 行号已转成十进制文本, 格式化时只拷贝字节.
+struct SourceLoc {
+    const char *file;
+    size_t file_len;
+    const char *line;
+    size_t line_len;
+    const char *func;
+    size_t func_len;
+    LogLevel::Value level;
+};
+
+namespace source {
+
+// 路径中最后一个 '/' 或 '\\' 之后的位置
+constexpr size_t baseOffset(const char *path)
+{
+    size_t pos = 0;
+    for (size_t i = 0; path[i] != '\0'; ++i)
+        if (path[i] == '/' || path[i] == '\\')
+            pos = i + 1;
+    return pos;
+}
+
+struct Digits {
+    char data[12] = {};
+    size_t len = 0;
+};
+
+constexpr Digits digits(unsigned v)
+{
+    Digits d;
+    char tmp[12] = {};
+    size_t n = 0;
+    do
+    {
+        tmp[n++] = static_cast<char>('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    for (size_t i = 0; i < n; ++i)
+        d.data[i] = tmp[n - 1 - i];
+    d.len = n;
+    return d;
+}
+
+template <unsigned Line>
+struct LineText {
+    static constexpr Digits text = digits(Line);
+};
+
+}
+
+// 一条待格式化的日志. 用户参数保持类型擦除, 由格式化器直接写到目标内存.
+// 结构化字段的键与值分两组存放, 值同样是 format_args, 不经过任何中间容器.
+struct LogMsg {
+    LogLevel::Value level;
+    std::chrono::system_clock::time_point time;
+    fmt::string_view fmt;
+    fmt::format_args args;
+    const fmt::string_view *field_keys = nullptr;
+    fmt::format_args field_values = {};
+    size_t field_count = 0;
+    fmt::string_view logger = {};   // 层级子 logger 的名称, 为空时用格式化器自己的名称
+    const SourceLoc *loc = nullptr; // 日志宏记录的调用点
+    // formatTo 写等级字段时记下其在输出中的偏移, 随记录交给 sink(控制台据此上色)
+    mutable size_t level_pos = kNoLevelPos;
+};
+
+// 结构化字段, 只引用调用方的值, 生命周期限于一次日志调用
+template <typename T>
+struct Field {
+    fmt::string_view key;
+    const T &value;
+};
+
+// logger->info("order placed", kv("id", id), kv("ms", dur));
+template <typename T>
+Field<T> kv(fmt::string_view key, const T &value)
+{
+    return Field<T>{key, value};
+}
+
+// 向定长内存追加格式化内容. 空间不足时只写能放下的部分, size 始终累计实际需要的长度,
+// 调用方据此判断是否需要换一块更大的区域重新格式化.
+class BoundedWriter {
+public:
+    BoundedWriter(char *out, size_t cap) : _out(out), _cap(cap), _size(0) {}
+
+    size_t size() const { return _size; }
+
+    template <typename... T>
+    void format(fmt::format_string<T...> f, T &&...args)
+    {
+        _size += fmt::format_to_n(cur(), room(), f, std::forward<T>(args)...).size;
+    }
+
+    void vformat(fmt::string_view f, fmt::format_args args)
+    {
+        _size += fmt::vformat_to_n(cur(), room(), f, args).size;
+    }
+
+    void append(const char *data, size_t len)
+    {
+        std::memcpy(cur(), data, std::min(len, room()));
+        _size += len;
+    }
+
+    void push_back(char c)
+    {
+        if (room() > 0)
+            *cur() = c;
+        ++_size;
+    }
+
+private:
+    char *cur() const { return _out + std::min(_size, _cap); }
+    size_t room() const { return _cap - std::min(_size, _cap); }
+
+    char *_out;
+    size_t _cap;
+    size_t _size;
+};
+
+// 把 fmt::memory_buffer 包装成与 BoundedWriter 相同的追加接口
+class MemoryWriter {
+public:
+    explicit MemoryWriter(fmt::memory_buffer &buf) : _buf(buf) {}
+
+    template <typename... T>
+    void format(fmt::format_string<T...> f, T &&...args)
+    {
+        fmt::format_to(fmt::appender(_buf), f, std::forward<T>(args)...);
+    }
+
+    void vformat(fmt::string_view f, fmt::format_args args)
+    {
+        fmt::vformat_to(fmt::appender(_buf), f, args);
+    }
+
+    size_t size() const { return _buf.size(); }
+
+    void append(const char *data, size_t len) { _buf.append(data, data + len); }
+
+    void push_back(char c) { _buf.push_back(c); }
+
+private:
+    fmt::memory_buffer &_buf;
+};
+
+// 同步路径(formatLog)用的线程本地可复用缓冲区
+inline fmt::memory_buffer &scratch()
+{
+    thread_local fmt::memory_buffer buf;
+    buf.clear();
+    return buf;
+}
+
+// ==================== 字段编码 ====================
+namespace encode {
+
+// JSON 字符串转义: 引号、反斜杠和控制字符. 用 simd::findJson 跳过干净的字节,
+// 连续的干净字节整段拷贝
+template <typename W>
+void jsonEscape(W &w, fmt::string_view s)
+{
+    static const char kHex[] = "0123456789abcdef";
+    const char *p = s.data();
+    const char *end = p + s.size();
+    while (true)
+    {
+        const char *hit = simd::findJson(p, end);
+        w.append(p, static_cast<size_t>(hit - p));
+        if (hit == end)
+            break;
+        unsigned char c = static_cast<unsigned char>(*hit);
+        switch (c)
+        {
+        case '"':  w.append("\\\"", 2); break;
+        case '\\': w.append("\\\\", 2); break;
+        case '\n': w.append("\\n", 2); break;
+        case '\r': w.append("\\r", 2); break;
+        case '\t': w.append("\\t", 2); break;
+        case '\b': w.append("\\b", 2); break;
+        case '\f': w.append("\\f", 2); break;
+        default:
+        {
+            char u[6] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xf]};
+            w.append(u, 6);
+        }
+        }
+        p = hit + 1;
+    }
+}
+
+template <typename W>
+void jsonString(W &w, fmt::string_view s)
+{
+    w.push_back('"');
+    jsonEscape(w, s);
+    w.push_back('"');
+}
+
+// 文本格式的消息中和: 换行/回车写成 \n \r, 其他控制字符写成 \xHH, 制表符保留.
+// 保证一条记录只占一行, 也避免用户输入里的终端控制序列原样进入日志.
+template <typename W>
+void textEscape(W &w, fmt::string_view s)
+{
+    static const char kHex[] = "0123456789abcdef";
+    const char *p = s.data();
+    const char *end = p + s.size();
+    const char *run = p;
+    while (true)
+    {
+        const char *hit = simd::findControl(p, end);
+        if (hit == end)
+            break;
+        p = hit + 1;
+        unsigned char c = static_cast<unsigned char>(*hit);
+        if (c == '\t')
+            continue;
+        w.append(run, static_cast<size_t>(hit - run));
+        run = p;
+        if (c == '\n')
+            w.append("\\n", 2);
+        else if (c == '\r')
+            w.append("\\r", 2);
+        else
+        {
+            char x[4] = {'\\', 'x', kHex[c >> 4], kHex[c & 0xf]};
+            w.append(x, 4);
+        }
+    }
+    w.append(run, static_cast<size_t>(end - run));
+}
+
+// logfmt 值: 含空白、等号、引号或为空时加引号并转义
+template <typename W>
+void logfmtString(W &w, fmt::string_view s)
+{
+    const char *end = s.data() + s.size();
+    if (s.size() != 0 && simd::findLogfmt(s.data(), end) == end)
+    {
+        w.append(s.data(), s.size());
+        return;
+    }
+    jsonString(w, s);
+}
+
+// 用户消息需要先格式化出来才能转义
+inline fmt::string_view message(const LogMsg &msg)
+{
+    thread_local fmt::memory_buffer buf;
+    buf.clear();
+    fmt::vformat_to(fmt::appender(buf), msg.fmt, msg.args);
+    return fmt::string_view(buf.data(), buf.size());
+}
+
+// 按值的实际类型编码: 数字走 fmt 的整数/浮点快速路径, 字符串按 Style 转义,
+// 自定义类型先用其 formatter 格式化再当作字符串处理.
+enum class Style { Text, Json, Logfmt };
+
+template <Style S, typename W>
+class ValueEncoder {
+public:
+    ValueEncoder(W &w, const fmt::basic_format_arg<fmt::format_context> &arg) : _w(w), _arg(arg) {}
+
+    void operator()(fmt::monostate) { _w.append("null", 4); }
+
+    void operator()(bool v)
+    {
+        if (v)
+            _w.append("true", 4);
+        else
+            _w.append("false", 5);
+    }
+
+    void operator()(char c) { string(fmt::string_view(&c, 1)); }
+
+    void operator()(const char *s) { string(s ? fmt::string_view(s) : fmt::string_view()); }
+
+    void operator()(fmt::string_view s) { string(s); }
+
+    void operator()(const void *p) { fallback(); (void)p; }
+
+    void operator()(typename fmt::basic_format_arg<fmt::format_context>::handle) { fallback(); }
+
+    template <typename T>
+    void operator()(T v)
+    {
+        if constexpr (std::is_floating_point<T>::value)
+        {
+            // JSON 不能表示 NaN/Inf
+            if (S == Style::Json && !(v == v && v - v == 0))
+            {
+                _w.append("null", 4);
+                return;
+            }
+            _w.format("{}", v);
+        }
+        else if constexpr (std::is_integral<T>::value)
+        {
+            _w.format("{}", v);
+        }
+        else
+        {
+            fallback();
+        }
+    }
+
+private:
+    void string(fmt::string_view s)
+    {
+        if (S == Style::Json)
+            jsonString(_w, s);
+        else if (S == Style::Logfmt)
+            logfmtString(_w, s);
+        else
+            textEscape(_w, s);
+    }
+
+    void fallback()
+    {
+        thread_local fmt::memory_buffer buf;
+        buf.clear();
+        fmt::vformat_to(fmt::appender(buf), "{}", fmt::format_args(&_arg, 1));
+        string(fmt::string_view(buf.data(), buf.size()));
+    }
+
+    W &_w;
+    const fmt::basic_format_arg<fmt::format_context> &_arg;
+};
+
+template <Style S, typename W>
+void value(W &w, const fmt::basic_format_arg<fmt::format_context> &arg)
+{
+    arg.visit(ValueEncoder<S, W>(w, arg));
+}
+
+// 文本格式在消息后以 " key=value" 形式追加字段
+template <typename W>
+void textFields(W &w, const LogMsg &msg)
+{
+    for (size_t i = 0; i < msg.field_count; ++i)
+    {
+        w.push_back(' ');
+        w.append(msg.field_keys[i].data(), msg.field_keys[i].size());
+        w.push_back('=');
+        value<Style::Logfmt>(w, msg.field_values.get(static_cast<int>(i)));
+    }
+}
+
+// 调用点 file:line, 作为 JSON 字符串内容或 logfmt 值. 常见的文件名不需要转义, 直接拷贝
+template <Style S, typename W>
+void source(W &w, const SourceLoc &loc)
+{
+    const char *end = loc.file + loc.file_len;
+    if (S == Style::Json)
+    {
+        jsonEscape(w, fmt::string_view(loc.file, loc.file_len));
+    }
+    else if (simd::findLogfmt(loc.file, end) != end)
+    {
+        fmt::memory_buffer buf;
+        buf.append(loc.file, end);
+        buf.push_back(':');
+        buf.append(loc.line, loc.line + loc.line_len);
+        logfmtString(w, fmt::string_view(buf.data(), buf.size()));
+        return;
+    }
+    else
+    {
+        w.append(loc.file, loc.file_len);
+    }
+    w.push_back(':');
+    w.append(loc.line, loc.line_len);
+}
+
+// 当前线程上下文(见 context.hpp)按 Style 渲染的文本, 上下文的 version 不变时直接复用:
+//   Text   "[req=42 tenant=acme] "    放在消息之前
+//   Logfmt " req=42 tenant=acme"      放在消息之后, 与字段相同
+//   Json   ,"req":"42","tenant":"acme"
+template <Style S>
+fmt::string_view contextText()
+{
+    const context::Stack &ctx = context::Stack::current();
+    if (ctx.empty())
+        return fmt::string_view();
+
+    struct Cache {
+        uint64_t version = ~uint64_t(0);
+        fmt::memory_buffer buf;
+    };
+    thread_local Cache cache;
+    if (cache.version != ctx.version())
+    {
+        cache.buf.clear();
+        MemoryWriter w(cache.buf);
+        bool first = true;
+        if (S == Style::Text)
+            w.push_back('[');
+        for (size_t i = 0; i < ctx.size(); ++i)
+        {
+            if (ctx.shadowed(i))
+                continue;
+            if (S == Style::Json)
+            {
+                w.push_back(',');
+                jsonString(w, ctx.key(i));
+                w.push_back(':');
+                jsonString(w, ctx.value(i));
+                continue;
+            }
+            if (S == Style::Logfmt || !first)
+                w.push_back(' ');
+            first = false;
+            textEscape(w, ctx.key(i));
+            w.push_back('=');
+            logfmtString(w, ctx.value(i));
+        }
+        if (S == Style::Text)
+            w.append("] ", 2);
+        cache.version = ctx.version();
+    }
+    return fmt::string_view(cache.buf.data(), cache.buf.size());
+}
+
+// 文本格式的消息体: 上下文前缀, 格式化后中和控制字符的消息, 再追加结构化字段
+template <typename W>
+void textMessage(W &w, const LogMsg &msg)
+{
+    fmt::string_view ctx = contextText<Style::Text>();
+    w.append(ctx.data(), ctx.size());
+    textEscape(w, message(msg));
+    textFields(w, msg);
+}
+
+}
+
 class LoggerFormat {
 public:
 
     enum FormatType {
         FORMAT_NORMAL = 0,
-        FORMAT_DETAIL
+        FORMAT_DETAIL,
+        FORMAT_JSON,
+        FORMAT_LOGFMT
     };
 
     using ptr = std::shared_ptr<LoggerFormat>;
@@ -29,8 +477,42 @@ public:
     virtual ~LoggerFormat() {}
 
     virtual std::string formatLog(LogLevel::Value level, const std::string& msg) = 0;
+
+    // 直接把整条日志(含用户消息)格式化到 out 指向的内存, 返回需要的总长度.
+    // 返回值大于 cap 时内容被截断, 调用方应按返回值重新预留空间后再调用一次.
+    virtual size_t formatTo(char *out, size_t cap, const LogMsg &msg)
+    {
+        std::string line = formatLog(msg.level, fmt::vformat(msg.fmt, msg.args));
+        std::memcpy(out, line.data(), std::min(line.size(), cap));
+        return line.size();
+    }
+
+    // 重复日志折叠的比较键: 一条已格式化日志去掉时间后的部分(名称、消息、字段仍在其中).
+    // 无法确定时间位置时返回整条.
+    virtual fmt::string_view repeatKey(const char *line, size_t len) const
+    {
+        return fmt::string_view(line, len);
+    }
     
 protected:
+    fmt::string_view loggerName(const LogMsg &msg) const
+    {
+        return msg.logger.size() ? msg.logger : fmt::string_view(_logName);
+    }
+
+    // 旧接口 formatLog 的公共实现: 把已格式化好的消息包成 LogMsg,
+    // 由 render(MemoryWriter &, const LogMsg &) 写进线程内暂存区后拷出
+    template <typename Render>
+    static std::string formatVia(LogLevel::Value level, const std::string &msg, Render &&render)
+    {
+        auto store = fmt::make_format_args(msg);
+        LogMsg m{level, std::chrono::system_clock::now(), "{}", store};
+        auto &buf = scratch();
+        MemoryWriter w(buf);
+        render(w, m);
+        return std::string(buf.data(), buf.size());
+    }
+
     std::string _logName;   //日志器名称
 };
 
@@ -41,7 +523,20 @@ public:
     std::string formatLog(LogLevel::Value level, const std::string& msg) override
     {
         // 默认格式化： [LEVEL] LoggerName: msg
-        return fmt::format("[{:<5}] {}\n", LogLevel::toString(level), msg);
+        auto &buf = scratch();
+        MemoryWriter w(buf);
+        encode::textEscape(w, msg);
+        return fmt::format("[{:<5}] {}\n", LogLevel::toString(level), fmt::string_view(buf.data(), buf.size()));
+    }
+
+    size_t formatTo(char *out, size_t cap, const LogMsg &msg) override
+    {
+        BoundedWriter w(out, cap);
+        msg.level_pos = 1;
+        w.format("[{:<5}] ", LogLevel::toString(msg.level));
+        encode::textMessage(w, msg);
+        w.push_back('\n');
+        return w.size();
     }
 };
 
@@ -54,9 +549,42 @@ public:
     std::string formatLog(LogLevel::Value level, const std::string& msg) override
     {
         // 默认格式化： [time][logger][LEVEL] msg
-        // Only keep second precision (no fractional seconds).
-        auto now = std::chrono::system_clock::now();
-        std::time_t tt = std::chrono::system_clock::to_time_t(now);
+        std::tm tm_local = localTime(std::chrono::system_clock::now());
+        auto &buf = scratch();
+        MemoryWriter w(buf);
+        encode::textEscape(w, msg);
+
+        return fmt::format("[{:%Y/%m/%d %H:%M:%S}][{}][{:<5}] {}\n",
+                            tm_local,
+                            _logName,
+                            LogLevel::toString(level),
+                            fmt::string_view(buf.data(), buf.size()));
+    }
+
+    size_t formatTo(char *out, size_t cap, const LogMsg &msg) override
+    {
+        std::tm tm_local = localTime(msg.time);
+
+        BoundedWriter w(out, cap);
+        w.format("[{:%Y/%m/%d %H:%M:%S}][{}][", tm_local, loggerName(msg));
+        msg.level_pos = w.size();
+        w.format("{:<5}] ", LogLevel::toString(msg.level));
+        encode::textMessage(w, msg);
+        w.push_back('\n');
+        return w.size();
+    }
+
+    // 去掉定长的 "[2026/02/02 15:53:23]"
+    fmt::string_view repeatKey(const char *line, size_t len) const override
+    {
+        return len >= 21 ? fmt::string_view(line + 21, len - 21) : fmt::string_view(line, len);
+    }
+
+private:
+    // Only keep second precision (no fractional seconds).
+    static std::tm localTime(std::chrono::system_clock::time_point tp)
+    {
+        std::time_t tt = std::chrono::system_clock::to_time_t(tp);
 
         std::tm tm_local{};
         #ifdef _WIN32
@@ -64,12 +592,508 @@ public:
         #else
             localtime_r(&tt, &tm_local);
         #endif
+        return tm_local;
+    }
+};
 
-        return fmt::format("[{:%Y/%m/%d %H:%M:%S}][{}][{:<5}] {}\n",
-                            tm_local,
-                            _logName,
-                            LogLevel::toString(level),
-                            msg);
+// ==================== 模式格式化 ====================
+// 模式串只解析一次, 得到一组扁平的操作(字面量/日期字段/等级/名称/线程号/消息),
+// 渲染时逐个 switch 追加到输出, 不再为每个占位符做虚调用或格式串解析.
+//
+//   %Y 年  %m 月  %d 日  %H 时  %M 分  %S 秒  %e 毫秒
+//   %l 等级(定宽 5)  %n 日志器名称  %t 线程号  %T 线程名  %v 消息  %% 百分号
+//   %s 源文件名  %# 行号  %! 函数名 (仅 YLOG_INFO 等宏记录调用点, 其余为空)
+//
+// %t/%T 取自写日志的线程缓存好的文本(见 util::thread::tag), 异步 logger 同样是调用方线程.
+//
+// 未识别的占位符按字面量输出, 每条日志末尾自动追加换行.
+namespace pattern {
+
+enum class OpKind : unsigned char {
+    Literal,
+    Year,
+    Month,
+    Day,
+    Hour,
+    Minute,
+    Second,
+    Millis,
+    Level,
+    Name,
+    Thread,
+    ThreadName,
+    SourceFile,
+    SourceLine,
+    SourceFunc,
+    Message
+};
+
+struct Op {
+    OpKind kind = OpKind::Literal;
+    size_t pos = 0;     // 字面量在模式串中的起点
+    size_t len = 0;
+};
+
+constexpr OpKind kindOf(char c)
+{
+    switch (c)
+    {
+    case 'Y': return OpKind::Year;
+    case 'm': return OpKind::Month;
+    case 'd': return OpKind::Day;
+    case 'H': return OpKind::Hour;
+    case 'M': return OpKind::Minute;
+    case 'S': return OpKind::Second;
+    case 'e': return OpKind::Millis;
+    case 'l': return OpKind::Level;
+    case 'n': return OpKind::Name;
+    case 't': return OpKind::Thread;
+    case 'T': return OpKind::ThreadName;
+    case 's': return OpKind::SourceFile;
+    case '#': return OpKind::SourceLine;
+    case '!': return OpKind::SourceFunc;
+    case 'v': return OpKind::Message;
+    default:  return OpKind::Literal;
+    }
+}
+
+// 解析模式串, out 为空时只计数. 运行期与编译期共用这一份实现.
+constexpr size_t parse(const char *p, size_t n, Op *out)
+{
+    size_t count = 0;
+    bool last_literal = false;
+    size_t last_end = 0;
+    size_t i = 0;
+    while (i < n)
+    {
+        OpKind kind = OpKind::Literal;
+        size_t pos = i;
+        size_t len = 1;
+        if (p[i] == '%' && i + 1 < n)
+        {
+            kind = kindOf(p[i + 1]);
+            if (kind != OpKind::Literal)
+                len = 0;
+            else if (p[i + 1] == '%')
+                pos = i + 1;    // %% 输出一个 %
+            else
+                len = 2;        // 未识别的占位符原样输出
+            i += 2;
+        }
+        else
+        {
+            ++i;
+        }
+
+        // 相邻字面量合并成一个操作
+        if (kind == OpKind::Literal && last_literal && last_end == pos)
+        {
+            if (out)
+                out[count - 1].len += len;
+            last_end += len;
+            continue;
+        }
+        if (out)
+            out[count] = Op{kind, pos, len};
+        ++count;
+        last_literal = kind == OpKind::Literal;
+        last_end = pos + len;
+    }
+    return count;
+}
+
+inline std::vector<Op> compile(const std::string &p)
+{
+    std::vector<Op> ops(parse(p.data(), p.size(), nullptr));
+    parse(p.data(), p.size(), ops.data());
+    return ops;
+}
+
+// 定宽等级字符串, 与 NormalFormat/DetailFormat 的 {:<5} 对齐方式一致
+inline const char *paddedLevel(LogLevel::Value level)
+{
+    switch (level)
+    {
+    case LogLevel::Value::DEBUG: return "DEBUG";
+    case LogLevel::Value::INFO:  return "INFO ";
+    case LogLevel::Value::WARN:  return "WARN ";
+    case LogLevel::Value::ERROR: return "ERROR";
+    case LogLevel::Value::FATAL: return "FATAL";
+    case LogLevel::Value::OFF:   return "OFF  ";
+    default:                      return "UNKNO";
+    }
+}
+
+// 每个线程缓存最近一秒的本地时间, 同一秒内的日志不再调用 localtime_r
+inline const std::tm &cachedLocalTime(std::time_t sec)
+{
+    thread_local std::time_t cached_sec = -1;
+    thread_local std::tm cached_tm{};
+    if (sec != cached_sec)
+    {
+        #ifdef _WIN32
+            localtime_s(&cached_tm, &sec);
+        #else
+            localtime_r(&sec, &cached_tm);
+        #endif
+        cached_sec = sec;
+    }
+    return cached_tm;
+}
+
+// 定宽补零输出 v 的低 Width 位十进制数字
+template <int Width, typename W>
+inline void appendDigits(W &w, unsigned v)
+{
+    static_assert(Width > 0 && Width <= 4, "appendDigits: width must be 1..4");
+    char buf[Width];
+    for (int i = Width - 1; i >= 0; --i)
+    {
+        buf[i] = static_cast<char>('0' + v % 10);
+        v /= 10;
+    }
+    w.append(buf, static_cast<size_t>(Width));
+}
+
+template <typename W>
+void render(W &w, const Op *ops, size_t n, const char *pattern,
+            fmt::string_view name, const LogMsg &msg)
+{
+    using namespace std::chrono;
+    auto since_epoch = msg.time.time_since_epoch();
+    auto sec = duration_cast<seconds>(since_epoch);
+    const std::tm &tm = cachedLocalTime(static_cast<std::time_t>(sec.count()));
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const Op &op = ops[i];
+        switch (op.kind)
+        {
+        case OpKind::Literal: w.append(pattern + op.pos, op.len); break;
+        case OpKind::Year:    appendDigits<4>(w, static_cast<unsigned>(tm.tm_year + 1900)); break;
+        case OpKind::Month:   appendDigits<2>(w, static_cast<unsigned>(tm.tm_mon + 1)); break;
+        case OpKind::Day:     appendDigits<2>(w, static_cast<unsigned>(tm.tm_mday)); break;
+        case OpKind::Hour:    appendDigits<2>(w, static_cast<unsigned>(tm.tm_hour)); break;
+        case OpKind::Minute:  appendDigits<2>(w, static_cast<unsigned>(tm.tm_min)); break;
+        case OpKind::Second:  appendDigits<2>(w, static_cast<unsigned>(tm.tm_sec)); break;
+        case OpKind::Millis:
+            appendDigits<3>(w, static_cast<unsigned>(duration_cast<milliseconds>(since_epoch - sec).count()));
+            break;
+        case OpKind::Level:
+            msg.level_pos = w.size();
+            w.append(paddedLevel(msg.level), 5);
+            break;
+        case OpKind::Name:    w.append(name.data(), name.size()); break;
+        case OpKind::Thread:
+        {
+            const std::string &id = util::thread::tag().id;
+            w.append(id.data(), id.size());
+            break;
+        }
+        case OpKind::ThreadName:
+        {
+            const std::string &tname = util::thread::tag().name;
+            w.append(tname.data(), tname.size());
+            break;
+        }
+        case OpKind::SourceFile:
+            if (msg.loc)
+                w.append(msg.loc->file, msg.loc->file_len);
+            break;
+        case OpKind::SourceLine:
+            if (msg.loc)
+                w.append(msg.loc->line, msg.loc->line_len);
+            break;
+        case OpKind::SourceFunc:
+            if (msg.loc)
+                w.append(msg.loc->func, msg.loc->func_len);
+            break;
+        case OpKind::Message:
+            encode::textMessage(w, msg);
+            break;
+        }
+    }
+    w.push_back('\n');
+}
+
+// 时间类操作的输出宽度, 其余返回 0
+constexpr size_t timeWidth(OpKind kind)
+{
+    switch (kind)
+    {
+    case OpKind::Year:    return 4;
+    case OpKind::Millis:  return 3;
+    case OpKind::Month:
+    case OpKind::Day:
+    case OpKind::Hour:
+    case OpKind::Minute:
+    case OpKind::Second:  return 2;
+    default:              return 0;
+    }
+}
+
+// 去掉最后一个时间字段及之前的部分. 只有这段前缀全是定长操作(字面量、时间、等级)时才能按偏移截取,
+// 否则(如 %n/%t/%T/%v 出现在时间之前)返回整条. 前缀中的等级由调用方单独比较.
+inline fmt::string_view repeatKey(const Op *ops, size_t n, const char *line, size_t len)
+{
+    size_t last = n;
+    for (size_t i = 0; i < n; ++i)
+        if (timeWidth(ops[i].kind) > 0)
+            last = i;
+    if (last == n)
+        return fmt::string_view(line, len);
+
+    size_t prefix = 0;
+    for (size_t i = 0; i <= last; ++i)
+    {
+        if (ops[i].kind == OpKind::Literal)
+            prefix += ops[i].len;
+        else if (ops[i].kind == OpKind::Level)
+            prefix += 5;
+        else if (timeWidth(ops[i].kind) > 0)
+            prefix += timeWidth(ops[i].kind);
+        else
+            return fmt::string_view(line, len);
+    }
+    if (prefix > len)
+        return fmt::string_view(line, len);
+    return fmt::string_view(line + prefix, len - prefix);
+}
+
+}
+
+// 运行期模式串
+class PatternFormat : public LoggerFormat {
+public:
+    using ptr = std::shared_ptr<PatternFormat>;
+
+    PatternFormat(const std::string &name, const std::string &pattern)
+        : LoggerFormat(name),
+            _pattern(pattern),
+            _ops(pattern::compile(_pattern))
+    {
+    }
+
+    std::string formatLog(LogLevel::Value level, const std::string& msg) override
+    {
+        return formatVia(level, msg, [this](MemoryWriter &w, const LogMsg &m) {
+            pattern::render(w, _ops.data(), _ops.size(), _pattern.data(), loggerName(m), m);
+        });
+    }
+
+    size_t formatTo(char *out, size_t cap, const LogMsg &msg) override
+    {
+        BoundedWriter w(out, cap);
+        pattern::render(w, _ops.data(), _ops.size(), _pattern.data(), loggerName(msg), msg);
+        return w.size();
+    }
+
+    fmt::string_view repeatKey(const char *line, size_t len) const override
+    {
+        return pattern::repeatKey(_ops.data(), _ops.size(), line, len);
+    }
+
+private:
+    std::string _pattern;
+    std::vector<pattern::Op> _ops;
+};
+
+// 编译期模式串: 模板参数为具有静态存储期的字符数组, 解析在编译期完成.
+//   static constexpr char kPattern[] = "[%Y-%m-%d %H:%M:%S.%e][%n][%l] %v";
+//   builder.buildLoggerFormat(std::make_shared<StaticPatternFormat<kPattern>>("app"));
+template <const char *Pattern>
+class StaticPatternFormat : public LoggerFormat {
+public:
+    using ptr = std::shared_ptr<StaticPatternFormat>;
+
+    StaticPatternFormat(const std::string &name) : LoggerFormat(name) {}
+
+    std::string formatLog(LogLevel::Value level, const std::string& msg) override
+    {
+        return formatVia(level, msg, [this](MemoryWriter &w, const LogMsg &m) {
+            pattern::render(w, kOps.data(), kOps.size(), Pattern, loggerName(m), m);
+        });
+    }
+
+    size_t formatTo(char *out, size_t cap, const LogMsg &msg) override
+    {
+        BoundedWriter w(out, cap);
+        pattern::render(w, kOps.data(), kOps.size(), Pattern, loggerName(msg), msg);
+        return w.size();
+    }
+
+    fmt::string_view repeatKey(const char *line, size_t len) const override
+    {
+        return pattern::repeatKey(kOps.data(), kOps.size(), line, len);
+    }
+
+private:
+    static constexpr size_t kLen = std::char_traits<char>::length(Pattern);
+    static constexpr size_t kCount = pattern::parse(Pattern, kLen, nullptr);
+
+    static constexpr std::array<pattern::Op, kCount> compile()
+    {
+        std::array<pattern::Op, kCount> ops{};
+        pattern::parse(Pattern, kLen, ops.data());
+        return ops;
+    }
+
+    static constexpr std::array<pattern::Op, kCount> kOps = compile();
+};
+
+// ==================== 结构化格式 ====================
+namespace encode {
+
+// 2026-02-02T15:53:23.123, 本地时间
+template <typename W>
+void isoTime(W &w, std::chrono::system_clock::time_point tp)
+{
+    using namespace std::chrono;
+    auto since_epoch = tp.time_since_epoch();
+    auto sec = duration_cast<seconds>(since_epoch);
+    const std::tm &tm = pattern::cachedLocalTime(static_cast<std::time_t>(sec.count()));
+    pattern::appendDigits<4>(w, static_cast<unsigned>(tm.tm_year + 1900));
+    w.push_back('-');
+    pattern::appendDigits<2>(w, static_cast<unsigned>(tm.tm_mon + 1));
+    w.push_back('-');
+    pattern::appendDigits<2>(w, static_cast<unsigned>(tm.tm_mday));
+    w.push_back('T');
+    pattern::appendDigits<2>(w, static_cast<unsigned>(tm.tm_hour));
+    w.push_back(':');
+    pattern::appendDigits<2>(w, static_cast<unsigned>(tm.tm_min));
+    w.push_back(':');
+    pattern::appendDigits<2>(w, static_cast<unsigned>(tm.tm_sec));
+    w.push_back('.');
+    pattern::appendDigits<3>(w, static_cast<unsigned>(duration_cast<milliseconds>(since_epoch - sec).count()));
+}
+
+}
+
+// 每条日志一个 JSON 对象:
+// {"time":"2026-02-02T15:53:23.123","level":"INFO","logger":"root","msg":"order placed","id":42}
+class JsonFormat : public LoggerFormat {
+public:
+    using ptr = std::shared_ptr<JsonFormat>;
+
+    JsonFormat(const std::string &name) : LoggerFormat(name) {}
+
+    std::string formatLog(LogLevel::Value level, const std::string& msg) override
+    {
+        return formatVia(level, msg, [this](MemoryWriter &w, const LogMsg &m) {
+            render(w, m);
+        });
+    }
+
+    size_t formatTo(char *out, size_t cap, const LogMsg &msg) override
+    {
+        BoundedWriter w(out, cap);
+        render(w, msg);
+        return w.size();
+    }
+
+    // 去掉定长的 {"time":"2026-02-02T15:53:23.123
+    fmt::string_view repeatKey(const char *line, size_t len) const override
+    {
+        return len >= 32 ? fmt::string_view(line + 32, len - 32) : fmt::string_view(line, len);
+    }
+
+private:
+    template <typename W>
+    void render(W &w, const LogMsg &msg)
+    {
+        w.append("{\"time\":\"", 9);
+        encode::isoTime(w, msg.time);
+        w.append("\",\"level\":\"", 11);
+        msg.level_pos = w.size();
+        const char *level = LogLevel::toString(msg.level);
+        w.append(level, std::strlen(level));
+        w.append("\",\"logger\":", 11);
+        encode::jsonString(w, loggerName(msg));
+        w.append(",\"msg\":", 7);
+        encode::jsonString(w, encode::message(msg));
+        if (msg.loc)
+        {
+            w.append(",\"src\":\"", 8);
+            encode::source<encode::Style::Json>(w, *msg.loc);
+            w.push_back('"');
+        }
+        fmt::string_view ctx = encode::contextText<encode::Style::Json>();
+        w.append(ctx.data(), ctx.size());
+        for (size_t i = 0; i < msg.field_count; ++i)
+        {
+            w.push_back(',');
+            encode::jsonString(w, msg.field_keys[i]);
+            w.push_back(':');
+            encode::value<encode::Style::Json>(w, msg.field_values.get(static_cast<int>(i)));
+        }
+        w.append("}\n", 2);
+    }
+};
+
+// logfmt: time=2026-02-02T15:53:23.123 level=info logger=root msg="order placed" id=42
+class LogfmtFormat : public LoggerFormat {
+public:
+    using ptr = std::shared_ptr<LogfmtFormat>;
+
+    LogfmtFormat(const std::string &name) : LoggerFormat(name) {}
+
+    std::string formatLog(LogLevel::Value level, const std::string& msg) override
+    {
+        return formatVia(level, msg, [this](MemoryWriter &w, const LogMsg &m) {
+            render(w, m);
+        });
+    }
+
+    size_t formatTo(char *out, size_t cap, const LogMsg &msg) override
+    {
+        BoundedWriter w(out, cap);
+        render(w, msg);
+        return w.size();
+    }
+
+    // 去掉定长的 time=2026-02-02T15:53:23.123
+    fmt::string_view repeatKey(const char *line, size_t len) const override
+    {
+        return len >= 28 ? fmt::string_view(line + 28, len - 28) : fmt::string_view(line, len);
+    }
+
+private:
+    static const char *lowerLevel(LogLevel::Value level)
+    {
+        switch (level)
+        {
+        case LogLevel::Value::DEBUG: return "debug";
+        case LogLevel::Value::INFO:  return "info";
+        case LogLevel::Value::WARN:  return "warn";
+        case LogLevel::Value::ERROR: return "error";
+        case LogLevel::Value::FATAL: return "fatal";
+        case LogLevel::Value::OFF:   return "off";
+        default:                      return "unknown";
+        }
+    }
+
+    template <typename W>
+    void render(W &w, const LogMsg &msg)
+    {
+        w.append("time=", 5);
+        encode::isoTime(w, msg.time);
+        w.append(" level=", 7);
+        msg.level_pos = w.size();
+        const char *level = lowerLevel(msg.level);
+        w.append(level, std::strlen(level));
+        w.append(" logger=", 8);
+        encode::logfmtString(w, loggerName(msg));
+        w.append(" msg=", 5);
+        encode::logfmtString(w, encode::message(msg));
+        if (msg.loc)
+        {
+            w.append(" src=", 5);
+            encode::source<encode::Style::Logfmt>(w, *msg.loc);
+        }
+        fmt::string_view ctx = encode::contextText<encode::Style::Logfmt>();
+        w.append(ctx.data(), ctx.size());
+        encode::textFields(w, msg);
+        w.push_back('\n');
     }
 };
 
@@ -2,12 +2,20 @@
 #define _YLOG_LOGGERMANAGER_H__
 
 #include "logger.hpp"
+#include "config.hpp"
 #include <mutex>
 #include <cassert>
 #include <vector>
 #include <string>
 #include <iostream>
 #include <unordered_map>
+#include <chrono>
+#include <atomic>
+#include <stdexcept>
+#include <sstream>
+#include <cstdlib>
+#include <utility>
+#include <algorithm>
 
 namespace YLog {
 
@@ -15,8 +23,11 @@ class Builder {
 public:
     using ptr = std::shared_ptr<Builder>;
     Builder()
-        : _level(LogLevel::Value::DEBUG),
-            _logger_type(Logger::Type::LOGGER_SYNC) {}
+        : _logger_type(Logger::Type::LOGGER_SYNC),
+            _level(LogLevel::Value::DEBUG),
+            _async_lanes(1),
+            _reopen_on_fork(false),
+            _repeat_window(0) {}
     void buildLoggerName(const std::string &name)
     {
         _logger_name = name;
@@ -32,6 +43,24 @@ public:
         _logger_type = type;
     }
 
+    // 异步日志器的生产队列数. 大于 1 时按线程分队列, 后台按时间归并输出
+    void buildAsyncLanes(size_t lanes)
+    {
+        _async_lanes = lanes;
+    }
+
+    // 异步日志器在 fork 出的子进程中是否重新打开 sink 文件
+    void buildReopenOnFork(bool reopen)
+    {
+        _reopen_on_fork = reopen;
+    }
+
+    // 连续重复日志折叠窗口, 窗口内相同的消息只输出一条并汇总次数. 默认关闭
+    void buildRepeatWindow(std::chrono::milliseconds window)
+    {
+        _repeat_window = window;
+    }
+
     void buildLoggerFormat(LoggerFormat::FormatType format)
     {
         if(format == LoggerFormat::FormatType::FORMAT_NORMAL)
@@ -42,6 +71,26 @@ public:
         {
             _format = std::make_shared<DetailFormat>(_logger_name);
         }
+        else if(format == LoggerFormat::FormatType::FORMAT_JSON)
+        {
+            _format = std::make_shared<JsonFormat>(_logger_name);
+        }
+        else if(format == LoggerFormat::FormatType::FORMAT_LOGFMT)
+        {
+            _format = std::make_shared<LogfmtFormat>(_logger_name);
+        }
+    }
+
+    // 按模式串格式化, 如 "[%Y-%m-%d %H:%M:%S.%e][%n][%l] %v". 需在 buildLoggerName 之后调用
+    void buildLoggerPattern(const std::string &pattern)
+    {
+        _format = std::make_shared<PatternFormat>(_logger_name, pattern);
+    }
+
+    // 直接指定格式化器, 如 StaticPatternFormat 或自定义实现
+    void buildLoggerFormat(LoggerFormat::ptr format)
+    {
+        _format = std::move(format);
     }
 
     template <typename SinkType, typename... Args>
@@ -51,6 +100,12 @@ public:
         _sinks.push_back(sink);
     }
 
+    // 添加已创建好的 sink
+    void buildSink(LogSink::ptr sink)
+    {
+        _sinks.push_back(std::move(sink));
+    }
+
     virtual Logger::ptr build() = 0;
 
 protected:
@@ -58,6 +113,9 @@ protected:
     Logger::Type _logger_type;
     std::string _logger_name;
     LogLevel::Value _level;
+    size_t _async_lanes;
+    bool _reopen_on_fork;
+    std::chrono::milliseconds _repeat_window;
     std::vector<LogSink::ptr> _sinks;
 };
 
@@ -79,12 +137,13 @@ public:
 
         if (_logger_type == Logger::Type::LOGGER_ASYNC)
         {
-            lp = std::make_shared<AsyncLogger>(_logger_name, _sinks, _level, _format);
+            lp = std::make_shared<AsyncLogger>(_logger_name, _sinks, _level, _format, _async_lanes, _reopen_on_fork);
         }
         else
         {
             lp = std::make_shared<SyncLogger>(_logger_name, _sinks, _level, _format);
         }
+        lp->setRepeatWindow(_repeat_window);
         return lp;
     }
 };
@@ -102,9 +161,26 @@ private:
         _root_logger = slb->build();
         assert(_root_logger && "Failed to initialize root logger");
         _loggers.insert({"root", _root_logger});
+        _root_logger->_registered.store(true, std::memory_order_release);
+        _levels.insert({"root", _root_logger->loggerLevel()});
+        publishLoggers();
+        Logger::levelHook().store([](Logger &logger, LogLevel::Value level) {
+            getInstance().setLevel(logger, level);
+        }, std::memory_order_release);
+
+        // 启动时读取一次环境变量, 如 YLOG_LEVEL="info,db.*=debug"
+        if (const char *spec = std::getenv("YLOG_LEVEL"))
+        {
+            applyLevelSpec(spec);
+        }
     }
 
-    ~LoggerMgr() = default;
+    ~LoggerMgr()
+    {
+        Logger::levelHook().store(nullptr, std::memory_order_release);
+        unwatchConfig();
+        delete _snapshot.load();
+    }
 
     LoggerMgr(const LoggerMgr &) = delete;
     LoggerMgr &operator=(const LoggerMgr &) = delete;
@@ -117,48 +193,416 @@ public:
         return lm;
     }
 
+    // 读路径不加锁: 查的是最近发布的只读快照
     bool hasLogger(const std::string &name)
+    {
+        SnapshotReader reader(*this);
+        return reader.loggers.find(name) != reader.loggers.end();
+    }
+
+    // 注册已配置的 logger. 同名的按需子 logger 会被取代: 它改为挂到新 logger 下,
+    // 已拿到它的调用方不受影响; 其余后代也重新挂到最近的已配置祖先.
+    void addLogger(const std::string &name, const Logger::ptr logger)
     {
         std::unique_lock<std::mutex> lock(_mutex);
-        auto it = _loggers.find(name);
-        if (it == _loggers.end())
+        addLoggerLocked(name, logger);
+    }
+
+    // 精确名称不存在时按层级创建子 logger: "db.pool.conn" 继承最近的已配置祖先
+    // ("db.pool" 或 "db", 都没有时为 root) 的 sink 与格式, 等级继承最近的设置过等级的祖先.
+    // 命中线程本地缓存时只比较哈希、generation 与名称; 未命中时查只读快照, 都不加锁.
+    // 只有名称第一次出现、需要创建子 logger 时才持锁.
+    Logger::ptr getLogger(const std::string &name)
+    {
+        size_t hash = std::hash<std::string>()(name);
+        uint64_t gen = generation();
+        LookupSlot &slot = lookupCache()[hash % kLookupSlots];
+        if (slot.logger && slot.hash == hash && slot.generation == gen && slot.name == name)
         {
-            return false;
+            return slot.logger;
         }
-        return true;
+
+        Logger::ptr logger;
+        {
+            SnapshotReader reader(*this);
+            auto found = reader.loggers.find(name);
+            if (found != reader.loggers.end())
+            {
+                logger = found->second;
+            }
+        }
+        if (!logger)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            auto it = _loggers.find(name);
+            if (it != _loggers.end())
+            {
+                logger = it->second;
+            }
+            else
+            {
+                applyRules(name);
+                std::vector<LogSink::ptr> no_sinks;
+                logger = std::make_shared<ChildLogger>(name, no_sinks, effectiveLevel(name), configuredAncestor(name));
+                logger->_registered.store(true, std::memory_order_release);
+                _loggers.insert({name, logger});
+                publishLoggers();
+            }
+        }
+        // 以查找前读到的 generation 标记, 期间若有 addLogger 下次会重新查找
+        slot.hash = hash;
+        slot.generation = gen;
+        slot.name = name;
+        slot.logger = logger;
+        return logger;
     }
 
-    void addLogger(const std::string &name, const Logger::ptr logger)
+    // root 在构造时创建且不再替换, 不加锁, 也不复制 shared_ptr(免得所有线程争用同一个引用计数)
+    const Logger::ptr &rootLogger() const
+    {
+        return _root_logger;
+    }
+
+    // 按名称或通配符设置等级, 如 setLevel("db", WARN)、setLevel("db.*", DEBUG).
+    // 匹配到的 logger 获得显式等级, 继承它们的后代一起生效; 规则会被记住,
+    // 之后创建或注册的同名/匹配的 logger 同样适用, 后设置的规则优先.
+    // 日志路径只读各 logger 自己的原子等级, 不受这里的锁影响.
+    void setLevel(const std::string &pattern, LogLevel::Value level)
     {
         std::unique_lock<std::mutex> lock(_mutex);
-        if (_loggers.find(name) != _loggers.end())
+        for (auto it = _rules.begin(); it != _rules.end(); ++it)
         {
-            throw std::runtime_error("Logger with the same name already exists");
+            if (it->first == pattern)
+            {
+                _rules.erase(it);
+                break;
+            }
+        }
+        _rules.emplace_back(pattern, level);
+
+        if (pattern.find_first_of("*?") == std::string::npos)
+        {
+            _levels[pattern] = level;
+            refreshLevels(pattern);
+            return;
+        }
+        for (auto &entry : _loggers)
+        {
+            if (util::string::globMatch(pattern, entry.first))
+            {
+                _levels[entry.first] = level;
+            }
         }
-        _loggers.insert({name, logger});
+        refreshLevels("root");
     }
 
-    Logger::ptr getLogger(const std::string &name)
+    // Logger::setLevel 登记的回调: 已注册的 logger 按名称处理, 否则只改它自己
+    void setLevel(Logger &logger, LogLevel::Value level)
     {
         std::unique_lock<std::mutex> lock(_mutex);
-        auto it = _loggers.find(name);
-        if (it == _loggers.end())
+        auto it = _loggers.find(logger._name);
+        if (it == _loggers.end() || it->second.get() != &logger)
         {
-            throw std::runtime_error("Logger not found: " + name);
+            logger.storeLevel(level);
+            return;
         }
-        return it->second;
+        _levels[logger._name] = level;
+        refreshLevels(logger._name);
     }
 
-    Logger::ptr rootLogger()
+    // 解析 "info,db.*=debug,net.http=warn": 不带名称的一项是 root 的等级, 其余依次 setLevel.
+    // 无法解析的项跳过并打印提示, 全部合法时返回 true
+    bool applyLevelSpec(const std::string &spec)
     {
+        bool ok = true;
+        std::stringstream ss(spec);
+        for (std::string item; std::getline(ss, item, ',');)
+        {
+            item = util::string::trim(item);
+            if (item.empty())
+            {
+                continue;
+            }
+            size_t eq = item.find('=');
+            std::string pattern = eq == std::string::npos ? "root" : util::string::trim(item.substr(0, eq));
+            std::string name = eq == std::string::npos ? item : util::string::trim(item.substr(eq + 1));
+            LogLevel::Value level;
+            if (pattern.empty() || !LogLevel::fromString(name, level))
+            {
+                std::cerr << "YLOG_LEVEL: 无法解析 \"" << item << "\"\n";
+                ok = false;
+                continue;
+            }
+            setLevel(pattern, level);
+        }
+        return ok;
+    }
+
+    // 按配置文件创建或更新 logger (格式见 config.hpp). 整份文件解析、sink 全部创建成功后
+    // 才应用, 任何错误都保持原配置不变并返回 false.
+    // 已存在的 logger 原地替换格式与 sink (见 Logger::reconfigure), 持有它的调用方无需重新获取;
+    // 配置中的等级作为它的显式等级, setLevel/YLOG_LEVEL 设置过的规则仍优先.
+    // type/lanes/reopen_on_fork/repeat_window_ms 只在创建时生效.
+    bool loadConfig(const std::string &path)
+    {
+        std::vector<LoggerConfig> configs;
+        std::string err;
+        if (!Config::load(path, configs, err))
+        {
+            std::cerr << "ylog 配置 " << path << " 未生效: " << err << "\n";
+            return false;
+        }
+
+        struct Prepared {
+            LoggerFormat::ptr format;
+            std::vector<LogSink::ptr> sinks;
+        };
+        std::vector<Prepared> prepared;
+        try
+        {
+            for (auto &c : configs)
+            {
+                prepared.push_back({Config::makeFormat(c), Config::makeSinks(c)});
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "ylog 配置 " << path << " 未生效: " << e.what() << "\n";
+            return false;
+        }
+
         std::unique_lock<std::mutex> lock(_mutex);
+        for (size_t i = 0; i < configs.size(); ++i)
+        {
+            const LoggerConfig &c = configs[i];
+            Prepared &p = prepared[i];
+            auto it = _loggers.find(c.name);
+            if (it != _loggers.end() && !isChild(it->second))
+            {
+                bool async = dynamic_cast<AsyncLogger *>(it->second.get()) != nullptr;
+                if (async != (c.type == Logger::Type::LOGGER_ASYNC))
+                {
+                    std::cerr << "ylog 配置: " << c.name << " 的 type 变化需重启后生效\n";
+                }
+                if (p.sinks.empty())
+                {
+                    p.sinks.push_back(std::make_shared<StdoutSink>());
+                }
+                it->second->reconfigure(p.format, p.sinks);
+                _levels[c.name] = c.level;
+                applyRules(c.name);
+                refreshLevels(c.name);
+                continue;
+            }
+
+            LoggerBuilder builder;
+            builder.buildLoggerName(c.name);
+            builder.buildLoggerType(c.type);
+            builder.buildLoggerLevel(c.level);
+            builder.buildAsyncLanes(c.lanes);
+            builder.buildReopenOnFork(c.reopen_on_fork);
+            builder.buildRepeatWindow(c.repeat_window);
+            builder.buildLoggerFormat(p.format);
+            for (auto &sink : p.sinks)
+            {
+                builder.buildSink(sink);
+            }
+            addLoggerLocked(c.name, builder.build());
+        }
+        return true;
+    }
+
+    // 加载配置文件并在它被修改后自动重新加载. 重复调用时改为监视新的文件
+    bool watchConfig(const std::string &path)
+    {
+        bool ok = loadConfig(path);
+        std::unique_lock<std::mutex> lock(_watch_mutex);
+        _watcher.reset();
+        _watcher.reset(new ConfigWatcher(path, [this, path]() { loadConfig(path); }));
+        if (!_watcher->ok())
+        {
+            std::cerr << "ylog 配置: 无法监视 " << path << "\n";
+            _watcher.reset();
+            return false;
+        }
+        return ok;
+    }
+
+    void unwatchConfig()
+    {
+        std::unique_lock<std::mutex> lock(_watch_mutex);
+        _watcher.reset();
+    }
+
+    // 名称层级或等级每变化一次加一, 缓存 logger 的调用方据此判断是否需要重新查找
+    uint64_t generation() const { return _generation.load(std::memory_order_acquire); }
+
+private:
+    static bool isChild(const Logger::ptr &logger)
+    {
+        return dynamic_cast<ChildLogger *>(logger.get()) != nullptr;
+    }
+
+    // "db.pool.conn" -> "db.pool" -> "db" -> "root"
+    static std::string parentName(const std::string &name)
+    {
+        size_t pos = name.rfind('.');
+        return pos == std::string::npos ? std::string("root") : name.substr(0, pos);
+    }
+
+    static bool isDescendant(const std::string &name, const std::string &ancestor)
+    {
+        if (ancestor == "root")
+            return name != "root";
+        return name.size() > ancestor.size() && name.compare(0, ancestor.size(), ancestor) == 0
+            && name[ancestor.size()] == '.';
+    }
+
+    using LoggerMap = std::unordered_map<std::string, Logger::ptr>;
+
+    static constexpr size_t kLookupSlots = 16;
+
+    struct LookupSlot {
+        size_t hash = 0;
+        uint64_t generation = 0;
+        std::string name;
+        Logger::ptr logger;
+    };
+
+    static LookupSlot *lookupCache()
+    {
+        thread_local LookupSlot slots[kLookupSlots];
+        return slots;
+    }
+
+    // 读快照期间持有纪元(见 util::epoch), 发布新快照的线程据此判断旧快照何时可以释放
+    struct SnapshotReader {
+        explicit SnapshotReader(LoggerMgr &mgr) : loggers(*mgr._snapshot.load()) {}
+
+        util::epoch::Guard guard;   // 先于 loggers 初始化
+        const LoggerMap &loggers;
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        std::unique_ptr<const LoggerMap> loggers;
+    };
+
+    // 以下需持有 _mutex
+    // 复制一份 _loggers 发布给读路径. 旧快照可能仍被其他线程读取, 记下纪元放入 _retired,
+    // 已没有读者停留在其纪元的旧快照释放掉
+    void publishLoggers()
+    {
+        const LoggerMap *old = _snapshot.load();
+        _snapshot.store(new LoggerMap(_loggers));
+        if (old)
+        {
+            _retired.push_back(Retired{util::epoch::advance(), std::unique_ptr<const LoggerMap>(old)});
+        }
+        _retired.erase(std::remove_if(_retired.begin(), _retired.end(), [](const Retired &r) {
+            return util::epoch::idle(r.epoch);
+        }), _retired.end());
+    }
+
+    void addLoggerLocked(const std::string &name, const Logger::ptr &logger)
+    {
+        auto it = _loggers.find(name);
+        if (it != _loggers.end() && !isChild(it->second))
+        {
+            throw std::runtime_error("Logger with the same name already exists");
+        }
+        if (it != _loggers.end())
+        {
+            static_cast<ChildLogger &>(*it->second).setParent(logger);
+            _replaced.push_back(it->second);
+        }
+        _levels[name] = logger->loggerLevel();
+        applyRules(name);
+        _loggers[name] = logger;
+        logger->_registered.store(true, std::memory_order_release);
+        for (auto &entry : _loggers)
+        {
+            if (isChild(entry.second) && isDescendant(entry.first, name))
+            {
+                static_cast<ChildLogger &>(*entry.second).setParent(configuredAncestor(entry.first));
+            }
+        }
+        // 先发布快照再推进 generation, 看到新 generation 的线程一定能查到新 logger
+        publishLoggers();
+        refreshLevels(name);
+    }
+
+    Logger::ptr configuredAncestor(const std::string &name)
+    {
+        for (std::string cur = name; cur != "root";)
+        {
+            cur = parentName(cur);
+            auto it = _loggers.find(cur);
+            if (it != _loggers.end() && !isChild(it->second))
+            {
+                return it->second;
+            }
+        }
         return _root_logger;
     }
 
+    // 新出现的名称套用已记住的规则, 后设置的优先
+    void applyRules(const std::string &name)
+    {
+        for (auto &rule : _rules)
+        {
+            if (rule.first == name || util::string::globMatch(rule.first, name))
+            {
+                _levels[name] = rule.second;
+            }
+        }
+    }
+
+    LogLevel::Value effectiveLevel(const std::string &name)
+    {
+        for (std::string cur = name;; cur = parentName(cur))
+        {
+            auto it = _levels.find(cur);
+            if (it != _levels.end())
+            {
+                return it->second;
+            }
+            if (cur == "root")
+            {
+                return LogLevel::Value::DEBUG;
+            }
+        }
+    }
+
+    // 重新计算 name 及其后代的等级, 然后推进 generation
+    void refreshLevels(const std::string &name)
+    {
+        for (auto &entry : _loggers)
+        {
+            if (entry.first == name || isDescendant(entry.first, name))
+            {
+                entry.second->storeLevel(effectiveLevel(entry.first));
+            }
+        }
+        for (auto &logger : _replaced)
+        {
+            logger->storeLevel(effectiveLevel(logger->_name));
+        }
+        _generation.fetch_add(1, std::memory_order_release);
+    }
+
 private:
     std::mutex _mutex;
     Logger::ptr _root_logger;
-    std::unordered_map<std::string, Logger::ptr> _loggers;
+    LoggerMap _loggers;
+    std::atomic<const LoggerMap *> _snapshot{nullptr};     // _loggers 的只读副本, 读路径使用
+    std::vector<Retired> _retired;
+    std::unordered_map<std::string, LogLevel::Value> _levels;   // 显式设置过的等级
+    std::vector<std::pair<std::string, LogLevel::Value>> _rules;    // setLevel 设置过的名称/通配符
+    std::vector<Logger::ptr> _replaced;     // 被已配置 logger 取代的子 logger, 调用方可能仍持有
+    std::atomic<uint64_t> _generation{0};
+    std::mutex _watch_mutex;
+    std::unique_ptr<ConfigWatcher> _watcher;    // 最后声明, 最先停止, 回调里会用到上面的成员
 };
 
 }
@@ -2,6 +2,7 @@
 #define __YLOG_LOOPER_H__
 
 #include "util.hpp"
+#include "level.hpp"
 #include "buffer.hpp"
 
 #include <vector>
@@ -10,49 +11,230 @@
 #include <atomic>
 #include <condition_variable>
 #include <functional>
+#include <algorithm>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <queue>
+#include <new>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
 namespace YLog {
-    
+
 // 异步工作器. 输出线程
+// WARN 及以上的日志走独立的高优先级通道: 不等待普通缓冲区腾出空间, 也不受丢弃策略影响.
+// 后台线程每轮同时交换两个通道, 按记录序号归并后输出, 保证全局顺序不变.
+//
+// lanes > 1 时普通日志按线程分散到多个独立加锁的队列, 后台线程以堆做 k 路归并,
+// 按入队时间输出. 时间晚于本轮截止点的记录留到下一轮, 最多额外等待一个重排窗口.
+//
+// fork 安全: 所有实例登记在进程级列表中, 通过 pthread_atfork 在 fork 前等后台线程写完
+// 已入队的数据并持有全部锁, fork 后父进程解锁; 子进程解锁、清空继承来的队列并重新拉起后台线程.
 class AsyncWorker {
 public:
     using Functor = std::function<void(Buffer &buffer)>;
 
+    using ForkCallback = std::function<void()>;
+
     using ptr = std::shared_ptr<AsyncWorker>;
-    
-    AsyncWorker(const Functor &cb)
-        : _running(true),
-            _worker_callback(cb),
-            _thread([this](){ this->worker(); })
+
+    using clock = std::chrono::system_clock;
+
+    static constexpr LogLevel::Value kUrgentLevel = LogLevel::Value::WARN;
+
+    static constexpr std::chrono::milliseconds kDefaultReorderWindow{10};
+
+    AsyncWorker(const Functor &cb,
+                size_t lanes = 1,
+                std::chrono::milliseconds reorder_window = kDefaultReorderWindow)
+        : _worker_callback(cb),
+            _running(true),
+            _busy(false),
+            _round(0),
+            _seq(0),
+            _dirty(false),
+            _reorder_window(reorder_window),
+            _urgent_push(BUFFER_URGENT_SIZE),
+            _urgent_pop(BUFFER_URGENT_SIZE),
+            _merged(0),
+            _carry(0),
+            _next_carry(0),
+            _lanes(makeLanes(lanes)),
+            _thread(new std::thread(startThread()))
     {
+        registerFork(this);
     }
 
-    ~AsyncWorker() { stop(); }
+    ~AsyncWorker()
+    {
+        unregisterFork(this);
+        stop();
+    }
+
+    // 子进程重启后台线程之前调用, 用于重新打开文件等
+    void onForkChild(const ForkCallback &cb) { _fork_child_callback = cb; }
 
     void stop()
     {
-        _running = false;
-        _pop_cv.notify_all();
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _running = false;
+        }
+        _pop_cv->notify_all();
+
+        if(_thread->joinable())
+            _thread->join();
+    }
+
+    void push(const std::string &msg, LogLevel::Value level = LogLevel::Value::INFO)
+    {
+        pushWith(level, {}, msg.size(), [&](char *out, size_t cap, clock::time_point) {
+            std::memcpy(out, msg.data(), std::min(msg.size(), cap));
+            return msg.size();
+        });
+    }
 
-        if(_thread.joinable())
-            _thread.join();
+    // 预留/提交式写入: writer(out, cap, time) 直接把日志写进队列内存并返回实际需要的长度.
+    // logger 随记录保存, 须指向进程内常驻的字符串(见 util::string::intern).
+    // 返回值超过 cap 说明预估不足, 此时不提交, 按返回值重新预留后再写一次.
+    // 持锁期间完成格式化, 消息字节在调用方与 sink 之间只写一次; 放在队列之外的超大日志例外,
+    // 在锁外格式化(见 write).
+    // time 是在锁内取得的入队时间, 格式化器应使用它, 保证输出时间与归并顺序一致.
+    // context 为生产者线程的上下文编码(context::Stack::encoded), 随记录拷贝进队列, 可为空.
+    // level_pos 非空时在 writer 返回后读取, 作为等级字段在这条日志中的偏移一起提交.
+    template <typename Writer>
+    void pushWith(LogLevel::Value level, std::string_view logger, size_t estimate, Writer &&writer,
+                  std::string_view context = {}, const size_t *level_pos = nullptr)
+    {
+        pushVia(level, level, logger, estimate, writer, context, level_pos);
     }
 
-    void push(const std::string &msg)
+    // 同 pushWith, 但按 channel 而不是记录自身的等级选择通道.
+    // 回溯记录以触发记录的等级选通道, 与触发记录同一通道, 保证排在它之前, 记录仍带自己的等级
+    template <typename Writer>
+    void pushVia(LogLevel::Value channel, LogLevel::Value level, std::string_view logger, size_t estimate,
+                 Writer &&writer, std::string_view context = {}, const size_t *level_pos = nullptr)
     {
         if (_running == false)
             return;
+
+        // 高优先级通道按需扩容, 永不阻塞在 _push_cv 上
+        if (channel >= kUrgentLevel)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                write(lock, _urgent_push, nullptr, _seq, level, logger, context, level_pos, estimate, writer);
+            }
+            _pop_cv->notify_all();
+            return;
+        }
+
+        if (_lanes.empty())
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                write(lock, _tasks_push, _push_cv.get(), _seq, level, logger, context, level_pos, estimate, writer);
+            }
+            _pop_cv->notify_all();
+            return;
+        }
+
+        Lane &lane = *_lanes[laneIndex() % _lanes.size()];
+        {
+            std::unique_lock<std::mutex> lock(lane.mtx);
+            write(lock, lane.push, lane.push_cv.get(), lane.seq, level, logger, context, level_pos, estimate, writer);
+        }
+        // 只有在 _dirty 由 false 变 true 时才需要唤醒, 避免每条日志都争抢 _mtx
+        if (!_dirty.load(std::memory_order_relaxed) && !_dirty.exchange(true))
         {
             std::unique_lock<std::mutex> lock(_mtx);
-            _push_cv.wait(lock, [&](){ 
-                return _tasks_push.WritableSize() >= msg.size(); 
-            });
-            _tasks_push.push(msg.c_str(), msg.size());
+            _pop_cv->notify_all();
         }
-        _pop_cv.notify_all();
     }
 
 private:
+    struct Lane {
+        Lane(size_t size) : push(size), pop(size) {}
+
+        std::mutex mtx;
+        std::unique_ptr<std::condition_variable> push_cv{new std::condition_variable};     // 见 restartInChild
+        uint64_t seq = 0;
+        Buffer push;
+        Buffer pop;
+    };
+
+    // 各队列平分默认缓冲区大小, 线程数多时总内存不随之线性增长
+    static std::vector<std::unique_ptr<Lane>> makeLanes(size_t n)
+    {
+        std::vector<std::unique_ptr<Lane>> lanes;
+        if (n > 1)
+        {
+            size_t size = std::max<size_t>(BUFFER_DEFAULT_SIZE / n, BUFFER_URGENT_SIZE);
+            for (size_t i = 0; i < n; ++i)
+                lanes.push_back(std::make_unique<Lane>(size));
+        }
+        return lanes;
+    }
+
+    // 每个线程首次写日志时分到一个固定编号
+    static size_t laneIndex()
+    {
+        static std::atomic<size_t> next{0};
+        thread_local size_t idx = next.fetch_add(1, std::memory_order_relaxed);
+        return idx;
+    }
+
+    // cv 为空表示该缓冲区按需扩容, 不等待可写空间
+    template <typename Writer>
+    static void write(std::unique_lock<std::mutex> &lock, Buffer &buf, std::condition_variable *cv,
+                        uint64_t &seq, LogLevel::Value level, std::string_view logger, std::string_view context,
+                        const size_t *level_pos, size_t estimate, Writer &writer)
+    {
+        size_t need = estimate;
+        while (true)
+        {
+            // 超大且放不进剩余空间的日志格式化到单独分配的内存, 不等待也不扩容缓冲区.
+            // 分配与格式化期间不持锁, 其他生产者和后台线程交换队列不受影响; 重新加锁后才取
+            // 序号与入队时间提交, 队列内记录的序号与时间仍然有序(日志文本中的时间为格式化时刻)
+            if (need > BUFFER_LARGE_SIZE && buf.WritableSize() < need)
+            {
+                lock.unlock();
+                std::string data;
+                auto time = clock::now();
+                size_t len = need;
+                do
+                {
+                    data.resize(len);
+                    len = writer(data.data(), data.size(), time);
+                } while (len > data.size());
+                data.resize(len);
+                size_t pos = level_pos ? *level_pos : kNoLevelPos;
+                lock.lock();
+                buf.commitExternal(std::move(data), seq++, level, clock::now(), logger, context, pos);
+                break;
+            }
+            if (cv)
+            {
+                cv->wait(lock, [&](){
+                    return buf.WritableSize() >= need;
+                });
+            }
+            char *out = buf.reserve(need);
+            size_t cap = buf.WritableSize();
+            auto time = clock::now();
+            size_t len = writer(out, cap, time);
+            if (len <= cap)
+            {
+                buf.commitRecord(len, seq++, level, time, logger, context, level_pos ? *level_pos : kNoLevelPos);
+                break;
+            }
+            need = len;
+        }
+    }
+
     void worker()
     {
         // 死循环,保证工作线程一直运行
@@ -61,37 +243,356 @@ private:
             {
                 std::unique_lock<std::mutex> lock(_mtx);
                 // 等待任务队列有数据或工作线程停止
-                _pop_cv.wait(lock, [this](){ 
-                    return !_running || !_tasks_push.empty(); 
+                _pop_cv->wait(lock, [this](){
+                    return !_running || !_tasks_push.empty() || !_urgent_push.empty();
                 });
 
-                if (!_running && _tasks_push.empty())
+                if (!_running && _tasks_push.empty() && _urgent_push.empty())
                 {
                     // 如果工作线程停止且任务队列为空，退出循环
                     return;
                 }
                 // 交换缓冲区
                 _tasks_push.swap(_tasks_pop);
+                _urgent_push.swap(_urgent_pop);
+                _busy = true;
             }
 
-            _push_cv.notify_all();
-            _worker_callback(_tasks_pop);
+            _push_cv->notify_all();
+            if (_urgent_pop.empty())
+            {
+                _worker_callback(_tasks_pop);
+            }
+            else
+            {
+                mergeBySeq(_urgent_pop, _tasks_pop, _merged);
+                _worker_callback(_merged);
+                _merged.reset();
+                _urgent_pop.reset();
+            }
             _tasks_pop.reset();
+            finishRound();
         }
 
         return;
     }
 
+    // 多队列模式的输出线程
+    void mergeWorker()
+    {
+        while (1)
+        {
+            clock::time_point cutoff;
+            bool running;
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                auto ready = [this](){
+                    return !_running || _dirty.load() || !_urgent_push.empty();
+                };
+                // 有滞留记录时最多等一个重排窗口, 到时无论是否有新数据都输出
+                if (_carry.empty())
+                    _pop_cv->wait(lock, ready);
+                else
+                    _pop_cv->wait_for(lock, _reorder_window, ready);
+
+                running = _running;
+                _dirty.store(false);
+                // 截止点必须在交换各队列之前取得: 时间不晚于它的记录此时都已入队
+                cutoff = running ? clock::now() : clock::time_point::max();
+                _urgent_push.swap(_urgent_pop);
+                _busy = true;
+            }
+
+            bool drained = _urgent_pop.empty() && _carry.empty();
+            for (auto &lane : _lanes)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(lane->mtx);
+                    lane->push.swap(lane->pop);
+                }
+                lane->push_cv->notify_all();
+                drained = drained && lane->pop.empty();
+            }
+
+            if (drained)
+            {
+                finishRound();
+                if (!running)
+                    return;
+                continue;
+            }
+
+            Buffer &out = mergeByTime(cutoff);
+            if (!out.empty())
+                _worker_callback(out);
+
+            out.reset();
+            _merged.reset();
+            _urgent_pop.reset();
+            for (auto &lane : _lanes)
+                lane->pop.reset();
+            finishRound();
+        }
+    }
+
+    std::thread startThread()
+    {
+        return std::thread([this](){ _lanes.empty() ? this->worker() : this->mergeWorker(); });
+    }
+
+    // 一轮输出结束, 唤醒等待 fork 的线程
+    void finishRound()
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _busy = false;
+            ++_round;
+        }
+        _idle_cv->notify_all();
+    }
+
+    bool hasPending()
+    {
+        if (_busy || !_tasks_push.empty() || !_urgent_push.empty() || _dirty.load())
+            return true;
+        return false;
+    }
+
+    // ==================== fork 处理 ====================
+    static std::mutex &forkMutex()
+    {
+        static std::mutex mtx;
+        return mtx;
+    }
+
+    static std::vector<AsyncWorker *> &forkRegistry()
+    {
+        static std::vector<AsyncWorker *> workers;
+        return workers;
+    }
+
+    static void registerFork(AsyncWorker *w)
+    {
+#ifndef _WIN32
+        static bool installed = (pthread_atfork(&AsyncWorker::atforkPrepare,
+                                                &AsyncWorker::atforkParent,
+                                                &AsyncWorker::atforkChild), true);
+        (void)installed;
+#endif
+        std::unique_lock<std::mutex> lock(forkMutex());
+        forkRegistry().push_back(w);
+    }
+
+    static void unregisterFork(AsyncWorker *w)
+    {
+        std::unique_lock<std::mutex> lock(forkMutex());
+        auto &workers = forkRegistry();
+        workers.erase(std::remove(workers.begin(), workers.end(), w), workers.end());
+    }
+
+    // 锁在 prepare 中获取, 分别在 parent/child 中释放, 因此不能用 RAII
+    static void atforkPrepare()
+    {
+        forkMutex().lock();
+        for (auto *w : forkRegistry())
+            w->quiesce();
+    }
+
+    static void atforkParent()
+    {
+        for (auto *w : forkRegistry())
+            w->resume();
+        forkMutex().unlock();
+    }
+
+    static void atforkChild()
+    {
+        for (auto *w : forkRegistry())
+            w->restartInChild();
+        forkMutex().unlock();
+    }
+
+    // 等后台线程把 fork 前已入队的数据写完, 然后持有全部锁直到 fork 完成.
+    // 无论是否还有待写数据都要等 _busy 清零: 队列可能刚被换走, 后台线程仍在 sink 里写,
+    // 此时 fork 会让子进程继承写了一半的文件状态和未释放的 sink 锁.
+    // 持有 _mtx 且 !_busy 时后台线程无法开始新一轮.
+    void quiesce()
+    {
+        std::unique_lock<std::mutex> lock(_mtx);
+        // 正在输出的这一轮不含之后入队的数据, 需要多等一轮
+        uint64_t target = _round + (_busy ? 2 : 1);
+        if (_running && hasPending())
+            _pop_cv->notify_all();
+        _idle_cv->wait(lock, [&](){
+            return !_busy && (!_running || _round >= target || !hasPending());
+        });
+        for (auto &lane : _lanes)
+            lane->mtx.lock();
+        lock.release();
+    }
+
+    void resume()
+    {
+        for (auto &lane : _lanes)
+            lane->mtx.unlock();
+        _mtx.unlock();
+    }
+
+    // 子进程只有调用 fork 的线程, 后台线程不复存在. 继承的队列内容归父进程输出, 这里丢弃.
+    void restartInChild()
+    {
+        for (auto &lane : _lanes)
+        {
+            lane->push.reset();
+            lane->pop.reset();
+            abandon(lane->push_cv, new std::condition_variable);
+        }
+        _tasks_push.reset();
+        _tasks_pop.reset();
+        _urgent_push.reset();
+        _urgent_pop.reset();
+        _merged.reset();
+        _carry.reset();
+        _next_carry.reset();
+        _dirty = false;
+        _busy = false;
+        // 等待者已不存在, 条件变量内部状态不可信, 换成新建的
+        abandon(_push_cv, new std::condition_variable);
+        abandon(_pop_cv, new std::condition_variable);
+        abandon(_idle_cv, new std::condition_variable);
+        resume();
+
+        if (!_running)
+            return;
+
+        if (_fork_child_callback)
+            _fork_child_callback();
+
+        // 旧线程句柄在子进程中既不能 join 也不能析构(会 terminate), 只能放弃
+        abandon(_thread, new std::thread(startThread()));
+    }
+
+    // 子进程中放弃从父进程继承的对象, 换成 fresh. 旧对象有意泄漏: 条件变量可能记着父进程里
+    // 已不存在的等待者, 在其上析构是未定义行为; 仍可 join 的线程句柄析构会 terminate.
+    // 每个 AsyncWorker 每次 fork 只泄漏这几个小对象
+    template <typename T>
+    static void abandon(std::unique_ptr<T> &owner, T *fresh)
+    {
+        owner.release();
+        owner.reset(fresh);
+    }
+
+    // 两个通道内部各自有序, 按序号双路归并到 out
+    static void mergeBySeq(Buffer &urgent, Buffer &normal, Buffer &out)
+    {
+        const auto &u = urgent.records();
+        const auto &n = normal.records();
+        size_t i = 0, j = 0;
+        while (i < u.size() || j < n.size())
+        {
+            if (j == n.size() || (i < u.size() && u[i].seq < n[j].seq))
+            {
+                out.takeRecord(urgent, u[i]);
+                ++i;
+            }
+            else
+            {
+                out.takeRecord(normal, n[j]);
+                ++j;
+            }
+        }
+    }
+
+    // 以小顶堆归并上轮滞留记录、高优先级通道和各线程队列, 返回本轮要输出的缓冲区.
+    // 时间不晚于 cutoff 的写入 _merged, 其余按序留到 _carry 等下一轮.
+    // 只有一个来源有数据且都不晚于 cutoff 时(如只有一个线程在写)直接输出该来源, 不拷贝;
+    // 否则每次从堆顶来源取出一段不晚于其他来源下一条的连续记录, 整段拷贝, 堆操作按段而不是按条
+    Buffer &mergeByTime(clock::time_point cutoff)
+    {
+        struct Cursor {
+            clock::time_point time;
+            size_t src;
+            size_t idx;
+            bool operator>(const Cursor &o) const
+            {
+                return time != o.time ? time > o.time : src > o.src;
+            }
+        };
+
+        _sources.clear();
+        _sources.push_back(&_carry);
+        _sources.push_back(&_urgent_pop);
+        for (auto &lane : _lanes)
+            _sources.push_back(&lane->pop);
+
+        Buffer *only = nullptr;
+        size_t nonempty = 0;
+        for (Buffer *src : _sources)
+        {
+            if (!src->records().empty())
+            {
+                only = src;
+                ++nonempty;
+            }
+        }
+        if (nonempty == 1 && only->records().back().time <= cutoff)
+            return *only;
+
+        std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>> heap;
+        for (size_t s = 0; s < _sources.size(); ++s)
+        {
+            if (!_sources[s]->records().empty())
+                heap.push(Cursor{_sources[s]->records()[0].time, s, 0});
+        }
+
+        while (!heap.empty())
+        {
+            Cursor c = heap.top();
+            heap.pop();
+            Buffer &src = *_sources[c.src];
+            const auto &records = src.records();
+            bool due = records[c.idx].time <= cutoff;
+            // 段的终点: 不越过 cutoff, 也不越过其他来源的下一条(时间相同时按来源编号)
+            size_t end = c.idx + 1;
+            while (end < records.size() && (records[end].time <= cutoff) == due
+                   && (heap.empty() || !(Cursor{records[end].time, c.src, end} > heap.top())))
+                ++end;
+            (due ? _merged : _next_carry).takeRecords(src, c.idx, end - c.idx);
+
+            if (end < records.size())
+                heap.push(Cursor{records[end].time, c.src, end});
+        }
+
+        _carry.reset();
+        _carry.swap(_next_carry);
+        return _merged;
+    }
+
 private:
     Functor _worker_callback;
+    ForkCallback _fork_child_callback;
     std::mutex _mtx;
     std::atomic<bool> _running;
-    std::condition_variable _push_cv;
-    std::condition_variable _pop_cv;
+    bool _busy;             // 后台线程正在输出, 受 _mtx 保护
+    uint64_t _round;        // 已完成的输出轮数, 受 _mtx 保护
+    uint64_t _seq;          // 受 _mtx 保护
+    std::atomic<bool> _dirty;       // 多队列模式下是否有新数据
+    std::chrono::milliseconds _reorder_window;
+    // 条件变量与线程句柄经指针持有, 子进程可以丢弃继承来的对象而不必在其上原地重建(见 restartInChild)
+    std::unique_ptr<std::condition_variable> _push_cv{new std::condition_variable};
+    std::unique_ptr<std::condition_variable> _pop_cv{new std::condition_variable};
+    std::unique_ptr<std::condition_variable> _idle_cv{new std::condition_variable};
     Buffer _tasks_push;
     Buffer _tasks_pop;
-    std::thread _thread;
+    Buffer _urgent_push;
+    Buffer _urgent_pop;
+    Buffer _merged;
+    Buffer _carry;
+    Buffer _next_carry;
+    std::vector<Buffer *> _sources;
+    std::vector<std::unique_ptr<Lane>> _lanes;
+    std::unique_ptr<std::thread> _thread;
 };
 }
 
-#endif
\ No newline at end of file
+#endif
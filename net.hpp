@@ -0,0 +1,779 @@
+#ifndef __YLOG_NET_H__
+#define __YLOG_NET_H__
+
+// 网络 sink: 直接把日志交给本机或远端的收集器, 不经过本地文件.
+//
+//   SyslogSink: RFC 5424 格式的数据报, 地址为 Unix 套接字路径("/dev/log")或 UDP "host:port".
+//     builder.buildSink<SyslogSink>("/dev/log", "order-service");
+//     builder.buildSink<SyslogSink>("127.0.0.1:514");
+//   TcpSink: TCP 流, 由 sink 自己的线程发送, 断线期间写入本地 spool 文件, 重连后补发.
+//     builder.buildSink<TcpSink>("collector:5170", "./logs/spool/app.spool");
+//
+// 套接字均为非阻塞, 收集器不在时日志线程不会等待网络.
+// 只支持 POSIX.
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sink.hpp"
+#include "3rdparty/fmt/format.h"
+
+namespace YLog {
+namespace net {
+
+// "/path" 或 "./path" 为 Unix 套接字, 否则按 "host:port" 解析(IPv6 写作 "[::1]:514")
+inline bool resolve(const std::string &address, int type, sockaddr_storage &addr, socklen_t &len)
+{
+    std::memset(&addr, 0, sizeof(addr));
+    if (address.find('/') != std::string::npos)
+    {
+        sockaddr_un *un = reinterpret_cast<sockaddr_un *>(&addr);
+        if (address.size() >= sizeof(un->sun_path))
+            return false;
+        un->sun_family = AF_UNIX;
+        std::memcpy(un->sun_path, address.c_str(), address.size() + 1);
+        len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + address.size() + 1);
+        return true;
+    }
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon + 1 == address.size())
+        return false;
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+        host = host.substr(1, host.size() - 2);
+
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = type;
+    addrinfo *res = nullptr;
+    if (::getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0 || res == nullptr)
+        return false;
+    std::memcpy(&addr, res->ai_addr, res->ai_addrlen);
+    len = static_cast<socklen_t>(res->ai_addrlen);
+    ::freeaddrinfo(res);
+    return true;
+}
+
+inline int openSocket(int family, int type)
+{
+#ifdef SOCK_NONBLOCK
+    return ::socket(family, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+#else
+    int fd = ::socket(family, type, 0);
+    if (fd >= 0)
+    {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+#endif
+}
+
+}
+
+// RFC 5424 syslog 数据报 sink. 每条记录一个数据报:
+//   <PRI>1 2026-01-02T03:04:05.678901Z host app pid - - 格式化好的日志(去掉行尾换行)
+// 异步 logger 交付的一批记录先在 sink 内攒批, 满 batch 条或批末 flush 时用一次 sendmmsg 发出
+// (非 Linux 逐条 send); 同步 logger 或其他线程批外的记录立即发出(连同已攒下的).
+// 连接失败后每秒最多重连一次, 期间的记录计入 dropped().
+class SyslogSink : public LogSink {
+public:
+    using ptr = std::shared_ptr<SyslogSink>;
+
+    static constexpr int kFacilityUser = 1;
+    static constexpr int kFacilityLocal0 = 16;
+    static constexpr size_t kDefaultBatch = 32;
+    static constexpr size_t kMaxMessage = 8192;     // 超过的部分截断
+    static constexpr auto kRetryInterval = std::chrono::seconds(1);
+
+    SyslogSink(const std::string &address,
+               const std::string &app_name = "ylog",
+               int facility = kFacilityUser,
+               size_t batch = kDefaultBatch)
+        : _address(address),
+            _app(app_name.empty() ? "-" : app_name.substr(0, 48)),
+            _facility(facility),
+            _batch(batch == 0 ? 1 : batch)
+    {
+        if (!net::resolve(_address, SOCK_DGRAM, _addr, _addr_len))
+        {
+            throw std::runtime_error("SyslogSink: invalid address: " + _address);
+        }
+        char host[256] = {0};
+        if (::gethostname(host, sizeof(host) - 1) != 0 || host[0] == '\0')
+            _host = "-";
+        else
+            _host = host;
+        _spans.reserve(_batch);
+        connect();
+    }
+
+    ~SyslogSink() override
+    {
+        flush();
+        if (_fd >= 0)
+        {
+            ::close(_fd);
+        }
+    }
+
+    bool perRecord() const override { return true; }
+
+    void logRecord(const RecordView &rec) override
+    {
+        bool batching = inBatch();
+        std::unique_lock<std::mutex> lock(_mutex);
+        append(rec.level, rec.data, rec.len, rec.time);
+        if (!batching)
+            send();
+    }
+
+    // 不带等级与时间的整段字节按行拆开, 以 INFO 和当前时间发送
+    void log(const char *data, size_t len) override
+    {
+        bool batching = inBatch();
+        auto now = std::chrono::system_clock::now();
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (len > 0)
+        {
+            const char *nl = static_cast<const char *>(std::memchr(data, '\n', len));
+            size_t n = nl ? static_cast<size_t>(nl - data) + 1 : len;
+            append(LogLevel::Value::INFO, data, n, now);
+            data += n;
+            len -= n;
+        }
+        if (!batching)
+            send();
+    }
+
+    void flush() override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        send();
+    }
+
+    void reopen() override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        send();
+        disconnect();
+        connect();
+    }
+
+    uint64_t sent() const { return _sent.load(std::memory_order_relaxed); }
+
+    uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+    // RFC 5424 severity: emerg 0 ... debug 7
+    static int severity(LogLevel::Value level)
+    {
+        switch (level)
+        {
+        case LogLevel::Value::DEBUG: return 7;
+        case LogLevel::Value::INFO:  return 6;
+        case LogLevel::Value::WARN:  return 4;
+        case LogLevel::Value::ERROR: return 3;
+        case LogLevel::Value::FATAL: return 2;
+        default:                     return 6;
+        }
+    }
+
+private:
+    void append(LogLevel::Value level, const char *data, size_t len, std::chrono::system_clock::time_point time)
+    {
+        while (len > 0 && (data[len - 1] == '\n' || data[len - 1] == '\r'))
+            --len;
+        if (len > kMaxMessage)
+            len = kMaxMessage;
+
+        size_t begin = _buf.size();
+        auto out = std::back_inserter(_buf);
+        fmt::format_to(out, "<{}>1 ", _facility * 8 + severity(level));
+        appendTime(out, time);
+        fmt::format_to(out, " {} {} {} - - ", _host, _app, static_cast<long>(::getpid()));
+        _buf.append(data, len);
+        _spans.emplace_back(begin, _buf.size() - begin);
+        if (_spans.size() >= _batch)
+        {
+            send();
+        }
+    }
+
+    // TIMESTAMP 取记录自己的时间(异步队列中为入队时间), 而不是发送时刻. 秒级部分按秒缓存
+    template <typename Out>
+    void appendTime(Out out, std::chrono::system_clock::time_point time)
+    {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+        std::time_t sec = static_cast<std::time_t>(us / 1000000);
+        if (sec != _time_sec)
+        {
+            std::tm tm{};
+            ::gmtime_r(&sec, &tm);
+            char text[32];
+            size_t n = std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &tm);
+            _time_text.assign(text, n);
+            _time_sec = sec;
+        }
+        fmt::format_to(out, "{}.{:06}Z", _time_text, static_cast<long>(us % 1000000));
+    }
+
+    bool connect()
+    {
+        _fd = net::openSocket(_addr.ss_family, SOCK_DGRAM);
+        if (_fd < 0)
+            return false;
+        if (::connect(_fd, reinterpret_cast<sockaddr *>(&_addr), _addr_len) != 0)
+        {
+            disconnect();
+            return false;
+        }
+        return true;
+    }
+
+    void disconnect()
+    {
+        if (_fd >= 0)
+        {
+            ::close(_fd);
+            _fd = -1;
+        }
+        _retry_at = std::chrono::steady_clock::now() + kRetryInterval;
+    }
+
+    void send()
+    {
+        if (_spans.empty())
+            return;
+        size_t total = _spans.size();
+        size_t done = 0;
+        if (_fd < 0 && std::chrono::steady_clock::now() >= _retry_at)
+        {
+            connect();
+        }
+        if (_fd >= 0)
+        {
+            done = sendAll();
+        }
+        _sent.fetch_add(done, std::memory_order_relaxed);
+        _dropped.fetch_add(total - done, std::memory_order_relaxed);
+        _buf.clear();
+        _spans.clear();
+    }
+
+    // 返回成功发出的条数; 对端不在时断开, 之后按间隔重连
+    size_t sendAll()
+    {
+        size_t n = _spans.size();
+        _iov.resize(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            _iov[i].iov_base = &_buf[_spans[i].first];
+            _iov[i].iov_len = _spans[i].second;
+        }
+
+        size_t done = 0;
+#ifdef __linux__
+        _msgs.resize(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            std::memset(&_msgs[i], 0, sizeof(mmsghdr));
+            _msgs[i].msg_hdr.msg_iov = &_iov[i];
+            _msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        while (done < n)
+        {
+            int r = ::sendmmsg(_fd, &_msgs[done], static_cast<unsigned int>(n - done), MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (r > 0)
+            {
+                done += static_cast<size_t>(r);
+                continue;
+            }
+            if (r < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+#else
+        while (done < n)
+        {
+            ssize_t r = ::send(_fd, _iov[done].iov_base, _iov[done].iov_len, MSG_DONTWAIT);
+            if (r >= 0)
+            {
+                ++done;
+                continue;
+            }
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+#endif
+        // 接收队列满只丢这一批; 其余错误(对端关闭、路径不存在等)断开后重连
+        if (done < n && errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS)
+        {
+            disconnect();
+        }
+        return done;
+    }
+
+    std::string _address;
+    std::string _app;
+    std::string _host;
+    int _facility;
+    size_t _batch;
+
+    sockaddr_storage _addr;
+    socklen_t _addr_len = 0;
+    int _fd = -1;
+    std::chrono::steady_clock::time_point _retry_at{};
+
+    std::mutex _mutex;
+    std::string _buf;                                   // 本批所有数据报首尾相接
+    std::vector<std::pair<size_t, size_t>> _spans;      // 每个数据报在 _buf 中的位置
+    std::vector<iovec> _iov;
+#ifdef __linux__
+    std::vector<mmsghdr> _msgs;
+#endif
+    std::time_t _time_sec = -1;
+    std::string _time_text;
+
+    std::atomic<uint64_t> _sent{0};
+    std::atomic<uint64_t> _dropped{0};
+};
+
+// TCP 流式 sink: 记录按帧(换行或 4 字节大端长度前缀)追加到内存批次, 由 sink 自己的线程发送,
+// logger 线程(包括 AsyncLogger::realLog)只做内存拷贝, 不碰网络.
+// 连接断开或尚未建立时批次写入本地 spool 文件(有上限, 满了丢弃新记录并计数), 重连后先按顺序补发 spool
+// 再发新记录; 发送失败时从未完整发出的那一帧开始保留并在新连接上整帧重发. 因此对端可能收到重复的帧,
+// 也可能在断开的旧连接末尾收到被截断的一帧(其完整版本随后在新连接上到达), 收集器应丢弃连接关闭时不完整的尾帧.
+// 同一连接内的帧总是完整的: spool 补发按整帧读取, 不会把一帧拆开.
+// 重连间隔从 100ms 起按 2 倍退避, 最长 30s. 进程退出时未发出的记录留在 spool 中, 下次启动后补发.
+class TcpSink : public LogSink {
+public:
+    using ptr = std::shared_ptr<TcpSink>;
+
+    enum class Framing { Newline, LengthPrefix };
+
+    static constexpr size_t kBatchBytes = 64 * 1024;            // 攒够即唤醒发送线程
+    static constexpr size_t kMaxPending = 8 * 1024 * 1024;      // 发送线程来不及取走时内存中最多积压
+    static constexpr size_t kDefaultSpoolBytes = 64 * 1024 * 1024;
+    static constexpr auto kIdleWake = std::chrono::milliseconds(100);
+    static constexpr auto kMinBackoff = std::chrono::milliseconds(100);
+    static constexpr auto kMaxBackoff = std::chrono::milliseconds(30000);
+    static constexpr auto kConnectTimeout = std::chrono::milliseconds(2000);
+    static constexpr auto kSendTimeout = std::chrono::milliseconds(5000);
+
+    TcpSink(const std::string &address,
+            const std::string &spool_path,
+            size_t spool_max = kDefaultSpoolBytes,
+            Framing framing = Framing::Newline)
+        : _address(address),
+            _spool_path(spool_path),
+            _spool_max(spool_max),
+            _framing(framing),
+            _backoff(kMinBackoff)
+    {
+        if (!net::resolve(_address, SOCK_STREAM, _addr, _addr_len))
+        {
+            throw std::runtime_error("TcpSink: invalid address: " + _address);
+        }
+        detail::ensure_parent_dir_exists(_spool_path);
+        _spool_fd = ::open(_spool_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (_spool_fd < 0)
+        {
+            throw std::runtime_error("TcpSink: failed to open spool: " + _spool_path);
+        }
+        struct stat st;
+        if (::fstat(_spool_fd, &st) == 0)
+            _spool_size = static_cast<uint64_t>(st.st_size);
+        _spooled.store(_spool_size, std::memory_order_relaxed);
+        _thread = std::thread([this]() { run(); });
+    }
+
+    ~TcpSink() override
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _running = false;
+        }
+        _cv.notify_one();
+        _thread.join();
+        if (_fd >= 0)
+            ::close(_fd);
+        ::close(_spool_fd);
+    }
+
+    bool perRecord() const override { return true; }
+
+    void logRecord(const RecordView &rec) override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        append(rec.data, rec.len);
+    }
+
+    // 整段字节按行拆成记录
+    void log(const char *data, size_t len) override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (len > 0)
+        {
+            const char *nl = static_cast<const char *>(std::memchr(data, '\n', len));
+            size_t n = nl ? static_cast<size_t>(nl - data) + 1 : len;
+            append(data, n);
+            data += n;
+            len -= n;
+        }
+    }
+
+    // 只唤醒发送线程, 不等待网络
+    void flush() override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!_pending.empty())
+        {
+            _wake = true;
+            _cv.notify_one();
+        }
+    }
+
+    bool connected() const { return _connected.load(std::memory_order_relaxed); }
+
+    uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+    uint64_t sentBytes() const { return _sent_bytes.load(std::memory_order_relaxed); }
+
+    // spool 中等待补发的字节数
+    uint64_t spooled() const { return _spooled.load(std::memory_order_relaxed); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void append(const char *data, size_t len)
+    {
+        while (len > 0 && (data[len - 1] == '\n' || data[len - 1] == '\r'))
+            --len;
+        size_t need = len + (_framing == Framing::Newline ? 1 : 4);
+        if (_pending.size() + need > kMaxPending)
+        {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (_framing == Framing::LengthPrefix)
+        {
+            unsigned char prefix[4] = {static_cast<unsigned char>(len >> 24), static_cast<unsigned char>(len >> 16),
+                                       static_cast<unsigned char>(len >> 8), static_cast<unsigned char>(len)};
+            _pending.append(reinterpret_cast<const char *>(prefix), 4);
+            _pending.append(data, len);
+        }
+        else
+        {
+            _pending.append(data, len);
+            _pending.push_back('\n');
+        }
+        if (_pending.size() >= kBatchBytes && !_wake)
+        {
+            _wake = true;
+            _cv.notify_one();
+        }
+    }
+
+    // data 开头连续的完整帧的总长度, frames 为帧数
+    size_t completeFrames(const char *data, size_t len, size_t &frames) const
+    {
+        frames = 0;
+        size_t end = 0;
+        if (_framing == Framing::Newline)
+        {
+            for (size_t i = 0; i < len; ++i)
+            {
+                if (data[i] == '\n')
+                {
+                    ++frames;
+                    end = i + 1;
+                }
+            }
+            return end;
+        }
+        while (end + 4 <= len)
+        {
+            const unsigned char *p = reinterpret_cast<const unsigned char *>(data + end);
+            size_t n = (size_t(p[0]) << 24) | (size_t(p[1]) << 16) | (size_t(p[2]) << 8) | size_t(p[3]);
+            if (end + 4 + n > len)
+                break;
+            end += 4 + n;
+            ++frames;
+        }
+        return end;
+    }
+
+    void run()
+    {
+        util::thread::setName("ylog-tcp");
+        std::string batch;
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true)
+        {
+            _cv.wait_for(lock, kIdleWake, [this]() { return !_running || _wake; });
+            _wake = false;
+            bool stopping = !_running;
+            batch.swap(_pending);
+            lock.unlock();
+            ship(batch, stopping);
+            batch.clear();
+            lock.lock();
+            if (stopping && _pending.empty())
+                break;
+        }
+    }
+
+    // 发送线程: 先补发 spool, 再发本批; 发不出去的部分追加到 spool
+    void ship(const std::string &batch, bool stopping)
+    {
+        if (_fd < 0 && !stopping && Clock::now() >= _next_attempt && (_spool_size > 0 || !batch.empty()))
+            connect();
+        if (_fd >= 0 && !peerAlive())
+            disconnect();
+        if (_fd >= 0 && _spool_size > 0)
+            replaySpool();
+
+        const char *rest = batch.data();
+        size_t rest_len = batch.size();
+        if (_fd >= 0 && _spool_size == 0 && rest_len > 0)
+        {
+            size_t sent = sendAll(rest, rest_len);
+            if (sent < rest_len)
+            {
+                size_t frames;
+                size_t whole = completeFrames(rest, sent, frames);
+                rest += whole;
+                rest_len -= whole;
+                disconnect();
+            }
+            else
+            {
+                rest_len = 0;
+            }
+        }
+        if (rest_len > 0)
+            spool(rest, rest_len);
+    }
+
+    // 非阻塞 connect, 最多等 kConnectTimeout; 失败后按退避间隔再试
+    void connect()
+    {
+        _fd = net::openSocket(_addr.ss_family, SOCK_STREAM);
+        bool ok = _fd >= 0;
+        if (ok && ::connect(_fd, reinterpret_cast<sockaddr *>(&_addr), _addr_len) != 0)
+        {
+            ok = errno == EINPROGRESS && waitFd(POLLOUT, kConnectTimeout);
+            int err = 0;
+            socklen_t len = sizeof(err);
+            ok = ok && ::getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0;
+        }
+        if (!ok)
+        {
+            if (_fd >= 0)
+                ::close(_fd);
+            _fd = -1;
+            _next_attempt = Clock::now() + _backoff;
+            _backoff = std::min<std::chrono::milliseconds>(_backoff * 2, kMaxBackoff);
+            return;
+        }
+        _backoff = kMinBackoff;
+        _connected.store(true, std::memory_order_relaxed);
+    }
+
+    void disconnect()
+    {
+        ::close(_fd);
+        _fd = -1;
+        _connected.store(false, std::memory_order_relaxed);
+        _next_attempt = Clock::now() + _backoff;
+    }
+
+    bool waitFd(short events, std::chrono::milliseconds timeout)
+    {
+        pollfd pfd{_fd, events, 0};
+        int r;
+        do
+        {
+            r = ::poll(&pfd, 1, static_cast<int>(timeout.count()));
+        } while (r < 0 && errno == EINTR);
+        return r > 0 && (pfd.revents & events);
+    }
+
+    // 对端已关闭(收到 FIN/RST)时不再往这个连接写, 避免写进内核缓冲后丢失
+    bool peerAlive()
+    {
+        char c;
+        ssize_t r = ::recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (r == 0)
+            return false;
+        return r > 0 || errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+
+    // 返回成功交给内核的字节数
+    size_t sendAll(const char *data, size_t len)
+    {
+        size_t done = 0;
+        while (done < len)
+        {
+            ssize_t r = ::send(_fd, data + done, len - done, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (r > 0)
+            {
+                done += static_cast<size_t>(r);
+                continue;
+            }
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && waitFd(POLLOUT, kSendTimeout))
+                continue;
+            break;
+        }
+        _sent_bytes.fetch_add(done, std::memory_order_relaxed);
+        return done;
+    }
+
+    void spool(const char *data, size_t len)
+    {
+        size_t frames;
+        completeFrames(data, len, frames);
+        if (_spool_size + len > _spool_max || !writeAt(data, len, _spool_size))
+        {
+            _dropped.fetch_add(frames, std::memory_order_relaxed);
+            return;
+        }
+        _spool_size += len;
+        _spooled.store(_spool_size, std::memory_order_relaxed);
+    }
+
+    bool writeAt(const char *data, size_t len, uint64_t off)
+    {
+        while (len > 0)
+        {
+            ssize_t r = ::pwrite(_spool_fd, data, len, static_cast<off_t>(off));
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0)
+                return false;
+            data += r;
+            len -= static_cast<size_t>(r);
+            off += static_cast<uint64_t>(r);
+        }
+        return true;
+    }
+
+    // 按块读出 spool 发送, 每块只发到最后一个完整帧, 下一块从帧边界开始;
+    // 中途失败时把未发完的部分移到文件开头
+    void replaySpool()
+    {
+        std::vector<char> chunk(kBatchBytes * 4);
+        uint64_t off = 0;
+        while (off < _spool_size)
+        {
+            size_t want = static_cast<size_t>(std::min<uint64_t>(chunk.size(), _spool_size - off));
+            ssize_t n = ::pread(_spool_fd, chunk.data(), want, static_cast<off_t>(off));
+            if (n <= 0)
+                break;
+            size_t frames;
+            size_t whole = completeFrames(chunk.data(), static_cast<size_t>(n), frames);
+            if (whole == 0)
+            {
+                // 块内容纳不下第一帧: 加倍块大小重读, 整帧发送, 不把一帧分成两段(下一段会被当成帧头)
+                if (off + static_cast<uint64_t>(n) < _spool_size)
+                {
+                    chunk.resize(chunk.size() * 2);
+                    continue;
+                }
+                // 文件末尾不成帧的残留(写 spool 时进程被杀), 丢弃而不是把半帧发给对端
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                off = _spool_size;
+                break;
+            }
+            size_t sent = sendAll(chunk.data(), whole);
+            if (sent < whole)
+            {
+                off += completeFrames(chunk.data(), sent, frames);
+                compactSpool(off);
+                disconnect();
+                return;
+            }
+            off += whole;
+        }
+        compactSpool(_spool_size);
+    }
+
+    void compactSpool(uint64_t from)
+    {
+        uint64_t remain = _spool_size - from;
+        std::vector<char> chunk(kBatchBytes);
+        uint64_t moved = 0;
+        while (moved < remain)
+        {
+            size_t want = static_cast<size_t>(std::min<uint64_t>(chunk.size(), remain - moved));
+            ssize_t n = ::pread(_spool_fd, chunk.data(), want, static_cast<off_t>(from + moved));
+            if (n <= 0 || !writeAt(chunk.data(), static_cast<size_t>(n), moved))
+                break;
+            moved += static_cast<uint64_t>(n);
+        }
+        if (::ftruncate(_spool_fd, static_cast<off_t>(moved)) == 0)
+            _spool_size = moved;
+        _spooled.store(_spool_size, std::memory_order_relaxed);
+    }
+
+    std::string _address;
+    std::string _spool_path;
+    size_t _spool_max;
+    Framing _framing;
+
+    sockaddr_storage _addr;
+    socklen_t _addr_len = 0;
+
+    // 以下只由发送线程使用
+    int _fd = -1;
+    int _spool_fd = -1;
+    uint64_t _spool_size = 0;
+    std::chrono::milliseconds _backoff;
+    Clock::time_point _next_attempt{};
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::string _pending;           // 已成帧、等待发送线程取走的记录
+    bool _wake = false;
+    bool _running = true;
+
+    std::atomic<bool> _connected{false};
+    std::atomic<uint64_t> _dropped{0};
+    std::atomic<uint64_t> _sent_bytes{0};
+    std::atomic<uint64_t> _spooled{0};
+    std::thread _thread;
+};
+
+}
+
+#endif // _WIN32
+
+#endif // __YLOG_NET_H__
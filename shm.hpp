@@ -0,0 +1,319 @@
+#ifndef __YLOG_SHM_H__
+#define __YLOG_SHM_H__
+
+// 共享内存环形队列: 应用进程只做内存拷贝, 由独立的 ylog_agent 进程取出并写文件.
+//
+//   应用:  builder.buildSink<ShmSink>("/ylog_app", 64 * 1024 * 1024);
+//   agent: ylog_agent /ylog_app ./logs/app.log 104857600
+//
+// 布局: [ShmHeader][data...], data 部分每条记录为 [uint32 长度][字节], 按 8 字节对齐;
+// 尾部放不下时写一个 kWrap 标记并从头开始. head 只由应用推进, tail 只由 agent 推进(单生产者/单消费者).
+// 队列满时丢弃并计数, 应用从不等待 agent; agent 退出后重新启动可以接着 tail 继续读.
+// agent 先 peek 取出记录, 写入并刷新到文件后才 commit 推进 tail, 崩溃前已写但未推进的记录会再输出一次.
+// 应用以不同容量重启时不在原处改大小(agent 可能仍映射着旧段): 旧段标记为作废后 unlink,
+// 新建一个同名段; agent 发现作废标记后取完旧段剩余记录再重新连接.
+// 只支持 POSIX (shm_open + mmap).
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <string>
+#include <mutex>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sink.hpp"
+
+namespace YLog {
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory ring needs lock-free 64-bit atomics");
+
+struct ShmHeader {
+    static constexpr uint64_t kMagic = 0x594c4f4753484d31ULL;     // "YLOGSHM1"
+    static constexpr uint64_t kRetired = 0x594c4f4753484d30ULL;   // "YLOGSHM0", 已被新段取代
+
+    std::atomic<uint64_t> magic;
+    uint64_t capacity;                      // data 部分字节数, 2 的幂, 初始化后不再改变
+    alignas(64) std::atomic<uint64_t> head; // 应用写到的位置
+    alignas(64) std::atomic<uint64_t> tail; // agent 读到的位置
+    alignas(64) std::atomic<uint64_t> written_records;
+    std::atomic<uint64_t> dropped_records;  // 队列满或记录过大而丢弃
+    std::atomic<uint64_t> dropped_bytes;
+};
+
+class ShmRing {
+public:
+    static constexpr uint32_t kWrap = 0xffffffffu;
+
+    ShmRing() = default;
+    ShmRing(const ShmRing &) = delete;
+    ShmRing &operator=(const ShmRing &) = delete;
+
+    ~ShmRing() { detach(); }
+
+    // 应用端: 不存在时创建; 已存在且容量一致时沿用(上次未取走的记录保留).
+    // 容量不同时不 ftruncate 旧段, 而是作废并 unlink 后新建, 已映射旧段的 agent 不会越界
+    void create(const std::string &name, size_t capacity)
+    {
+        size_t cap = 4096;
+        while (cap < capacity)
+            cap <<= 1;
+        std::string shm_name = normalize(name);
+        size_t size = sizeof(ShmHeader) + cap;
+        int fd = ::shm_open(shm_name.c_str(), O_RDWR | O_CREAT, 0600);
+        if (fd < 0)
+            throw std::runtime_error("shm_open failed: " + shm_name);
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("fstat failed: " + shm_name);
+        }
+        bool fresh = st.st_size == 0;
+        if (!fresh && static_cast<size_t>(st.st_size) != size)
+        {
+            retire(fd, static_cast<size_t>(st.st_size));
+            ::shm_unlink(shm_name.c_str());
+            fd = ::shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+            if (fd < 0)
+                throw std::runtime_error("shm_open failed: " + shm_name);
+            fresh = true;
+        }
+        if (fresh && ::ftruncate(fd, static_cast<off_t>(size)) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("ftruncate failed: " + shm_name);
+        }
+        map(fd, size, shm_name);
+        if (fresh || _header->magic.load(std::memory_order_acquire) != ShmHeader::kMagic || _header->capacity != cap)
+        {
+            _header->capacity = cap;
+            _header->head.store(0, std::memory_order_relaxed);
+            _header->tail.store(0, std::memory_order_relaxed);
+            _header->written_records.store(0, std::memory_order_relaxed);
+            _header->dropped_records.store(0, std::memory_order_relaxed);
+            _header->dropped_bytes.store(0, std::memory_order_relaxed);
+            _header->magic.store(ShmHeader::kMagic, std::memory_order_release);
+        }
+    }
+
+    // agent 端: 连接已有的队列(已连接时先断开), 不存在或尚未初始化时返回 false
+    bool attach(const std::string &name)
+    {
+        detach();
+        std::string shm_name = normalize(name);
+        int fd = ::shm_open(shm_name.c_str(), O_RDWR, 0);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) <= sizeof(ShmHeader))
+        {
+            ::close(fd);
+            return false;
+        }
+        map(fd, static_cast<size_t>(st.st_size), shm_name);
+        if (stale())
+        {
+            detach();
+            return false;
+        }
+        return true;
+    }
+
+    void detach()
+    {
+        if (_header)
+        {
+            ::munmap(_header, _map_size);
+            _header = nullptr;
+            _data = nullptr;
+            _map_size = 0;
+        }
+        _peeked = 0;
+    }
+
+    // agent 每轮检查: 段已被应用作废(容量变化后新建了同名段)或头部与映射大小不符时需要重新 attach
+    bool stale() const
+    {
+        return _header->magic.load(std::memory_order_acquire) != ShmHeader::kMagic
+            || sizeof(ShmHeader) + _header->capacity != _map_size;
+    }
+
+    static void unlink(const std::string &name) { ::shm_unlink(normalize(name).c_str()); }
+
+    // 单条记录的最大长度
+    size_t maxRecord() const { return static_cast<size_t>(_header->capacity / 2 - sizeof(uint32_t) - 8); }
+
+    const ShmHeader &header() const { return *_header; }
+
+    // 生产者: 写入一条记录, 空间不足时丢弃并返回 false. 调用方保证同一时刻只有一个写者
+    bool write(const char *data, size_t len)
+    {
+        const uint64_t cap = _header->capacity;
+        uint64_t need = align(sizeof(uint32_t) + len);
+        if (len > maxRecord())
+        {
+            drop(len);
+            return false;
+        }
+        uint64_t head = _header->head.load(std::memory_order_relaxed);
+        uint64_t tail = _header->tail.load(std::memory_order_acquire);
+        uint64_t off = head & (cap - 1);
+        uint64_t skip = cap - off < need ? cap - off : 0;    // 尾部放不下, 跳到开头
+        if (head + skip + need - tail > cap)
+        {
+            drop(len);
+            return false;
+        }
+        if (skip)
+        {
+            uint32_t wrap = kWrap;
+            std::memcpy(_data + off, &wrap, sizeof(wrap));
+            off = 0;
+        }
+        uint32_t n = static_cast<uint32_t>(len);
+        std::memcpy(_data + off, &n, sizeof(n));
+        std::memcpy(_data + off + sizeof(n), data, len);
+        _header->written_records.fetch_add(1, std::memory_order_relaxed);
+        _header->head.store(head + skip + need, std::memory_order_release);
+        return true;
+    }
+
+    // 消费者: 对当前所有记录调用 fn(data, len), 但不推进 tail, 返回记录条数.
+    // 记录在 commit 之前一直有效(生产者不会覆盖), 调用方写入并刷新后再 commit
+    template <typename Fn>
+    size_t peek(Fn &&fn)
+    {
+        const uint64_t cap = _header->capacity;
+        uint64_t tail = _header->tail.load(std::memory_order_relaxed);
+        uint64_t head = _header->head.load(std::memory_order_acquire);
+        size_t count = 0;
+        while (tail < head)
+        {
+            uint64_t off = tail & (cap - 1);
+            uint32_t n;
+            std::memcpy(&n, _data + off, sizeof(n));
+            if (n == kWrap)
+            {
+                tail += cap - off;
+                continue;
+            }
+            fn(_data + off + sizeof(n), static_cast<size_t>(n));
+            tail += align(sizeof(uint32_t) + n);
+            ++count;
+        }
+        _peeked = tail;
+        return count;
+    }
+
+    // 调用方处理完上一次 peek 取出的记录后确认(agent 在写入文件并 fdatasync 之后), 释放其空间
+    void commit()
+    {
+        if (_peeked > _header->tail.load(std::memory_order_relaxed))
+            _header->tail.store(_peeked, std::memory_order_release);
+    }
+
+    // peek + commit, 用于不需要处理完再确认的场合
+    template <typename Fn>
+    size_t read(Fn &&fn)
+    {
+        size_t count = peek(std::forward<Fn>(fn));
+        commit();
+        return count;
+    }
+
+private:
+    static std::string normalize(const std::string &name)
+    {
+        return !name.empty() && name[0] == '/' ? name : "/" + name;
+    }
+
+    static uint64_t align(uint64_t n) { return (n + 7) & ~uint64_t(7); }
+
+    void map(int fd, size_t size, const std::string &shm_name)
+    {
+        void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+            throw std::runtime_error("mmap failed: " + shm_name);
+        _header = static_cast<ShmHeader *>(p);
+        _data = static_cast<char *>(p) + sizeof(ShmHeader);
+        _map_size = size;
+    }
+
+    // 把将被取代的旧段标记为作废, 仍映射着它的 agent 据此重新连接
+    static void retire(int fd, size_t size)
+    {
+        if (size >= sizeof(ShmHeader))
+        {
+            void *p = ::mmap(nullptr, sizeof(ShmHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                static_cast<ShmHeader *>(p)->magic.store(ShmHeader::kRetired, std::memory_order_release);
+                ::munmap(p, sizeof(ShmHeader));
+            }
+        }
+        ::close(fd);
+    }
+
+    void drop(size_t len)
+    {
+        _header->dropped_records.fetch_add(1, std::memory_order_relaxed);
+        _header->dropped_bytes.fetch_add(len, std::memory_order_relaxed);
+    }
+
+    ShmHeader *_header = nullptr;
+    char *_data = nullptr;
+    size_t _map_size = 0;
+    uint64_t _peeked = 0;   // 上次 peek 读到的位置, 只由消费者使用
+};
+
+// 写入共享内存队列的 sink, 一条 log 调用对应一条记录(异步 logger 一次可能交来多行, 不超限时整体传递)
+class ShmSink : public LogSink {
+public:
+    using ptr = std::shared_ptr<ShmSink>;
+
+    ShmSink(const std::string &name, size_t capacity)
+    {
+        _ring.create(name, capacity);
+    }
+
+    // 超过单条上限(容量的一半)的大块按行切开, 单行本身超限时才丢弃
+    void log(const char *data, size_t len) override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        const size_t max = _ring.maxRecord();
+        while (len > max)
+        {
+            size_t piece = max;
+            while (piece > 0 && data[piece - 1] != '\n')
+                --piece;
+            if (piece == 0)
+                piece = max;
+            _ring.write(data, piece);
+            data += piece;
+            len -= piece;
+        }
+        if (len > 0)
+            _ring.write(data, len);
+    }
+
+    uint64_t dropped() const { return _ring.header().dropped_records.load(std::memory_order_relaxed); }
+
+private:
+    std::mutex _mutex;      // 同一个 sink 可能挂在多个 logger 上
+    ShmRing _ring;
+};
+
+}
+
+#endif // _WIN32
+
+#endif // __YLOG_SHM_H__
@@ -0,0 +1,124 @@
+#ifndef __YLOG_SIMD_H__
+#define __YLOG_SIMD_H__
+
+// 字符扫描: 在一段字节里找第一个需要特殊处理的字符(控制字符或指定的几个标点).
+// 干净的文本每次检查 16/32 字节, 命中后由调用方处理, 其余部分整段拷贝.
+//
+// 编译期选择实现: 定义了 __AVX2__ 用 AVX2(32 字节), x86/x64 默认 SSE2(16 字节),
+// 其他平台逐字节扫描. 三者结果完全一致.
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define YLOG_SIMD_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define YLOG_SIMD_SSE2 1
+#endif
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+namespace YLog {
+namespace simd {
+
+inline unsigned lowestBit(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return static_cast<unsigned>(idx);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+// 字节 c 是否特殊: c < Below 或等于 Extra 中任意一个
+template <unsigned char Below, char... Extra>
+inline bool special(char c)
+{
+    return static_cast<unsigned char>(c) < Below || ((c == Extra) || ...);
+}
+
+template <unsigned char Below, char... Extra>
+const char *scanScalar(const char *p, const char *end)
+{
+    for (; p < end; ++p)
+        if (special<Below, Extra...>(*p))
+            return p;
+    return end;
+}
+
+#if YLOG_SIMD_SSE2
+// c < Below 等价于 max(c, Below-1) == Below-1 (无符号比较)
+template <unsigned char Below, char... Extra>
+inline uint32_t mask16(__m128i v)
+{
+    const __m128i limit = _mm_set1_epi8(static_cast<char>(Below - 1));
+    __m128i hit = _mm_cmpeq_epi8(_mm_max_epu8(v, limit), limit);
+    ((hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8(Extra)))), ...);
+    return static_cast<uint32_t>(_mm_movemask_epi8(hit));
+}
+#endif
+
+#if YLOG_SIMD_AVX2
+template <unsigned char Below, char... Extra>
+inline uint32_t mask32(__m256i v)
+{
+    const __m256i limit = _mm256_set1_epi8(static_cast<char>(Below - 1));
+    __m256i hit = _mm256_cmpeq_epi8(_mm256_max_epu8(v, limit), limit);
+    ((hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(Extra)))), ...);
+    return static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+}
+#endif
+
+// 返回 [p, end) 中第一个特殊字节的位置, 没有则返回 end
+template <unsigned char Below, char... Extra>
+const char *scan(const char *p, const char *end)
+{
+#if YLOG_SIMD_AVX2
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        uint32_t m = mask32<Below, Extra...>(v);
+        if (m)
+            return p + lowestBit(m);
+    }
+#endif
+#if YLOG_SIMD_SSE2
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        uint32_t m = mask16<Below, Extra...>(v);
+        if (m)
+            return p + lowestBit(m);
+    }
+#endif
+    return scanScalar<Below, Extra...>(p, end);
+}
+
+// JSON 字符串里必须转义的字节
+inline const char *findJson(const char *p, const char *end)
+{
+    return scan<0x20, '"', '\\'>(p, end);
+}
+
+// 文本格式里需要中和的控制字符(含换行, 制表符由调用方放行)
+inline const char *findControl(const char *p, const char *end)
+{
+    return scan<0x20, '\x7f'>(p, end);
+}
+
+// logfmt 值需要加引号的字节: 空白/控制字符、等号、引号、反斜杠
+inline const char *findLogfmt(const char *p, const char *end)
+{
+    return scan<0x21, '=', '"', '\\'>(p, end);
+}
+
+}
+}
+
+#endif // __YLOG_SIMD_H__
@@ -2,6 +2,8 @@
 #define _YLOG_SINK_HPP__
 
 #include "util.hpp"
+#include "level.hpp"
+#include "context.hpp"
 #include <memory>
 #include <mutex>
 #include <fstream>
@@ -9,9 +11,45 @@
 #include <chrono>
 #include <filesystem>
 #include <iomanip>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <string_view>
+#include <list>
+#include <unordered_map>
+#include <condition_variable>
+#include <cctype>
+
+#ifndef _WIN32
+#include <csignal>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#else
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
 
 namespace YLog {
 
+// 与 iovec 布局相同, POSIX 上可直接交给 writev
+#ifdef _WIN32
+struct IoSlice {
+    void *iov_base;
+    size_t iov_len;
+};
+#else
+using IoSlice = struct iovec;
+#endif
+
 namespace detail {
 inline void ensure_parent_dir_exists(const std::string& filename)
 {
@@ -40,6 +78,135 @@ inline std::tm local_tm(std::time_t t)
     return out;
 }
 
+inline bool is_tty(int fd)
+{
+#ifdef _WIN32
+    return ::_isatty(fd) != 0;
+#else
+    return ::isatty(fd) != 0;
+#endif
+}
+
+inline bool color_allowed()
+{
+    const char *no_color = std::getenv("NO_COLOR");
+    const char *term = std::getenv("TERM");
+    return (no_color == nullptr || no_color[0] == '\0') && !(term && std::strcmp(term, "dumb") == 0);
+}
+
+// 写满 len 字节, 被信号打断时继续
+inline void write_fd(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+#ifdef _WIN32
+        int n = ::_write(fd, data, static_cast<unsigned int>(std::min<size_t>(len, 1u << 30)));
+#else
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+#endif
+        if (n <= 0)
+            return;
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+}
+
+inline int open_append(const std::string &path)
+{
+#ifdef _WIN32
+    return ::_open(path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+#endif
+}
+
+inline void close_fd(int fd)
+{
+#ifdef _WIN32
+    ::_close(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+// 把已写入内核的数据刷到存储设备, 成功返回 true
+inline bool sync_fd(int fd)
+{
+#if defined(_WIN32)
+    return ::_commit(fd) == 0;
+#elif defined(__APPLE__)
+    return ::fsync(fd) == 0;
+#else
+    return ::fdatasync(fd) == 0;
+#endif
+}
+
+// 依次写出 count 段, 处理部分写入与 IOV_MAX 限制
+inline void writev_fd(int fd, const IoSlice *iov, size_t count)
+{
+#ifdef _WIN32
+    for (size_t i = 0; i < count; ++i)
+        write_fd(fd, static_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+#else
+#ifdef IOV_MAX
+    constexpr size_t kMaxIov = IOV_MAX;
+#else
+    constexpr size_t kMaxIov = 1024;
+#endif
+    size_t i = 0;
+    while (i < count)
+    {
+        ssize_t n = ::writev(fd, iov + i, static_cast<int>(std::min(count - i, kMaxIov)));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        size_t left = static_cast<size_t>(n);
+        while (i < count && left >= iov[i].iov_len)
+        {
+            left -= iov[i].iov_len;
+            ++i;
+        }
+        // 写了一部分的那一段用 write 补完
+        if (left > 0)
+        {
+            write_fd(fd, static_cast<const char *>(iov[i].iov_base) + left, iov[i].iov_len - left);
+            ++i;
+        }
+    }
+#endif
+}
+
+constexpr const char *kColorReset = "\033[0m";
+
+inline const char *level_color(LogLevel::Value level)
+{
+    switch (level)
+    {
+    case LogLevel::Value::DEBUG: return "\033[36m";        // 青
+    case LogLevel::Value::INFO:  return "\033[32m";        // 绿
+    case LogLevel::Value::WARN:  return "\033[33m";        // 黄
+    case LogLevel::Value::ERROR: return "\033[31m";        // 红
+    case LogLevel::Value::FATAL: return "\033[1;37;41m";   // 红底白字
+    default:                     return "";
+    }
+}
+
+// logfmt 等格式输出小写的等级名称
+inline bool equals_ignore_case(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i])))
+            return false;
+    }
+    return true;
+}
+
 inline std::string format_time(const std::tm& tm, const char* fmt)
 {
     std::ostringstream oss;
@@ -47,6 +214,27 @@ inline std::string format_time(const std::tm& tm, const char* fmt)
     return oss.str();
 }
 }
+// 交给 sink 的一条记录: 格式化好的字节及其等级、时间、所属 logger. 只在一次调用期间有效.
+// context 为写日志线程的上下文编码(用 context::find 取值), 只在有 sink 的 wantsContext() 为 true 时填写.
+// level_pos 为等级名称在 data 中的偏移, 格式化器不提供时为 kNoLevelPos
+struct RecordView {
+    LogLevel::Value level;
+    std::chrono::system_clock::time_point time;
+    std::string_view logger;
+    const char *data;
+    size_t len;
+    std::string_view context = {};
+    size_t level_pos = kNoLevelPos;
+};
+
+// 一批记录: iov[i] 指向 records[i] 的字节, bytes 为总字节数. 只在一次调用期间有效
+struct RecordBatch {
+    const RecordView *records;
+    const IoSlice *iov;
+    size_t count;
+    size_t bytes;
+};
+
 // 抽象日志落地类
 class LogSink {
 public:
@@ -54,105 +242,309 @@ public:
     LogSink() = default;
     virtual ~LogSink() = default;
     virtual void log(const char *data, size_t len) = 0;
+    // 按条交付: 同步 logger 每条记录都经这里; 异步 logger 经默认的 logBatch 只对 perRecord() 为 true
+    // 的 sink 逐条调用, 其余 sink 收到合并后的整段字节. 需要记录边界或元数据的 sink(如 syslog) 覆盖这两个函数
+    virtual bool perRecord() const { return false; }
+    // 需要按上下文字段处理记录时返回 true, logger 才会把上下文随记录带到 RecordView::context
+    virtual bool wantsContext() const { return false; }
+    virtual void logRecord(const RecordView &rec) { log(rec.data, rec.len); }
+    // 异步 logger 每批队列调用一次. 默认转成旧接口: perRecord() 为 true 时逐条 logRecord,
+    // 否则把内存上相邻的记录合并成一段调用 log. 需要整批处理的 sink(如 writev) 覆盖它
+    virtual void logBatch(const RecordBatch &batch)
+    {
+        if (perRecord())
+        {
+            for (size_t i = 0; i < batch.count; ++i)
+                logRecord(batch.records[i]);
+            return;
+        }
+        const char *run = nullptr;
+        size_t run_len = 0;
+        for (size_t i = 0; i < batch.count; ++i)
+        {
+            const RecordView &rec = batch.records[i];
+            if (run && run + run_len == rec.data)
+            {
+                run_len += rec.len;
+                continue;
+            }
+            if (run_len > 0)
+                log(run, run_len);
+            run = rec.data;
+            run_len = rec.len;
+        }
+        if (run_len > 0)
+            log(run, run_len);
+    }
+    // 异步 logger 的后台线程经这里交付一批记录, 之后对每个 sink 调用 flush().
+    // logBatch 期间本线程的 inBatch() 为 true, sink 可以只攒不写, 留到 flush 写出;
+    // 其他线程(如共用这个 sink 的同步 logger)同时写入的记录不受影响, 仍立即写出.
+    void deliverBatch(const RecordBatch &batch)
+    {
+        struct Scope {
+            explicit Scope(const LogSink *sink) : outer(current()) { current() = sink; }
+            ~Scope() { current() = outer; }
+            const LogSink *outer;
+        } scope(this);
+        logBatch(batch);
+    }
     // Flush buffered output. Default no-op for sinks that don't buffer.
     virtual void flush() {}
+    // flush 之后再把数据同步到存储设备(fdatasync), 返回后掉电也不丢. 默认只 flush
+    virtual void sync() { flush(); }
+    // 重新打开底层文件(如 fork 后子进程不再与父进程共享句柄). 默认无操作
+    virtual void reopen() {}
+
+protected:
+    // 当前线程正在经 deliverBatch 向本 sink 交付一批记录
+    bool inBatch() const { return current() == this; }
+
+private:
+    static const LogSink *&current()
+    {
+        thread_local const LogSink *sink = nullptr;
+        return sink;
+    }
 };
 
-// 标准输出落地（控制台）
-class StdoutSink : public LogSink {
+// 控制台落地: 直接写文件描述符 1/2, 不经过 iostream.
+// 终端上给等级字段加 ANSI 颜色(位置由格式化器给出, 见 RecordView::level_pos);
+// 异步 logger 一批记录先攒在 sink 内, 批末 flush 时一次 write, 同步 logger 或其他线程批外的记录
+// 立即写出(连同已攒下的). 达到 flushOn 等级的记录在批内也立即写出.
+// 颜色: ColorMode::Auto 为终端且未设置 NO_COLOR、TERM 不是 dumb 时开启.
+class ConsoleSink : public LogSink {
 public:
-    using ptr = std::shared_ptr<StdoutSink>;
-    StdoutSink() = default;
-    ~StdoutSink() override = default;
+    using ptr = std::shared_ptr<ConsoleSink>;
 
-    void log(const char *msg, size_t len) override
+    enum class ColorMode { Auto, Always, Never };
+
+    static constexpr size_t kBufferSize = 64 * 1024;
+
+    ConsoleSink(bool to_stderr, ColorMode mode = ColorMode::Auto)
+        : _file(to_stderr ? stderr : stdout),
+            _fd(to_stderr ? 2 : 1)
     {
-        std::cout.write(msg, len);
-        std::cout.flush();  // 确保立即输出
+        _tty = detail::is_tty(_fd);
+        _color = mode == ColorMode::Always || (mode == ColorMode::Auto && _tty && detail::color_allowed());
+        _buf.reserve(kBufferSize);
     }
 
-    void flush() override
+    ~ConsoleSink() override
     {
-        std::cout.flush();
+        flush();
     }
-};
 
-// 标准错误输出落地
-class StderrSink : public LogSink {
-public:
-    using ptr = std::shared_ptr<StderrSink>;
-    StderrSink() = default;
-    ~StderrSink() override = default;
+    bool tty() const { return _tty; }
 
-    void log(const char *msg, size_t len) override
+    bool colored() const { return _color; }
+
+    // 批内达到该等级的记录立即写出(连同之前攒下的), 默认只在批末写出
+    void flushOn(LogLevel::Value level) { _flush_on.store(level, std::memory_order_relaxed); }
+
+    // 上色或设置了 flushOn 时需要每条记录的等级
+    bool perRecord() const override
+    {
+        return _color || _flush_on.load(std::memory_order_relaxed) != LogLevel::Value::OFF;
+    }
+
+    void logRecord(const RecordView &rec) override
     {
-        std::cerr.write(msg, len);
-        std::cerr.flush();  // 确保立即输出
+        bool batching = inBatch();
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_color)
+            appendColored(rec);
+        else
+            _buf.append(rec.data, rec.len);
+        if (!batching || rec.level >= _flush_on.load(std::memory_order_relaxed) || _buf.size() >= kBufferSize)
+            writeOut();
+    }
+
+    void log(const char *data, size_t len) override
+    {
+        bool batching = inBatch();
+        std::unique_lock<std::mutex> lock(_mutex);
+        // 大块直接写, 省一次拷贝
+        if (_buf.empty() && (len >= kBufferSize || !batching))
+        {
+            writeFd(data, len);
+            return;
+        }
+        _buf.append(data, len);
+        if (!batching || _buf.size() >= kBufferSize)
+            writeOut();
     }
 
     void flush() override
     {
-        std::cerr.flush();
+        std::unique_lock<std::mutex> lock(_mutex);
+        writeOut();
+    }
+
+private:
+    // 只给格式化器标出的等级名称上色; 没有位置或位置处不是等级名称时原样输出
+    void appendColored(const RecordView &rec)
+    {
+        std::string_view line(rec.data, rec.len);
+        std::string_view name = LogLevel::toString(rec.level);
+        size_t pos = rec.level_pos;
+        if (pos == kNoLevelPos || pos > line.size() || line.size() - pos < name.size()
+            || !detail::equals_ignore_case(line.substr(pos, name.size()), name))
+        {
+            _buf.append(rec.data, rec.len);
+            return;
+        }
+        _buf.append(rec.data, pos);
+        _buf.append(detail::level_color(rec.level));
+        _buf.append(rec.data + pos, name.size());
+        _buf.append(detail::kColorReset);
+        _buf.append(rec.data + pos + name.size(), rec.len - pos - name.size());
+    }
+
+    void writeOut()
+    {
+        if (_buf.empty())
+            return;
+        writeFd(_buf.data(), _buf.size());
+        _buf.clear();
+    }
+
+    // 先把 stdio 中别处打印的内容送出, 保持先后顺序
+    void writeFd(const char *data, size_t len)
+    {
+        std::fflush(_file);
+        detail::write_fd(_fd, data, len);
     }
+
+    std::FILE *_file;
+    int _fd;
+    bool _tty = false;
+    bool _color = false;
+    std::atomic<LogLevel::Value> _flush_on{LogLevel::Value::OFF};
+
+    std::mutex _mutex;
+    std::string _buf;
+};
+
+// 标准输出落地（控制台）
+class StdoutSink : public ConsoleSink {
+public:
+    using ptr = std::shared_ptr<StdoutSink>;
+    explicit StdoutSink(ColorMode mode = ColorMode::Auto) : ConsoleSink(false, mode) {}
+};
+
+// 标准错误输出落地
+class StderrSink : public ConsoleSink {
+public:
+    using ptr = std::shared_ptr<StderrSink>;
+    explicit StderrSink(ColorMode mode = ColorMode::Auto) : ConsoleSink(true, mode) {}
 };
 
 // 文件落地（固定文件名）
 class FileSink : public LogSink {
 public:
     using ptr = std::shared_ptr<FileSink>;
+
+    static constexpr size_t kBufferSize = 64 * 1024;
+
     FileSink(const std::string &filename) : _filename(filename)
     {
         // C++17: create parent directories via std::filesystem
         detail::ensure_parent_dir_exists(_filename);
-        // 以二进制追加模式打开
-        _ofs.open(_filename, std::ios::binary | std::ios::app);
+        // 以追加模式打开
+        _fd = detail::open_append(_filename);
 
-        if (!_ofs.is_open()) 
+        if (_fd < 0)
         {
             throw std::runtime_error("Failed to open log file: " + _filename);
         }
+        _buf.reserve(kBufferSize);
     }
 
     ~FileSink() override
     {
-        if (_ofs.is_open()) 
+        flush();
+        if (_fd >= 0)
         {
-            _ofs.close();
+            detail::close_fd(_fd);
         }
     }
 
     const std::string &file() const { return _filename; }
 
+    void reopen() override
+    {
+        flush();
+        if (_fd >= 0)
+        {
+            detail::close_fd(_fd);
+        }
+        _fd = detail::open_append(_filename);
+    }
+
+    // 同步 logger 或批外的单条记录立即写出(连同已攒下的); 批内先进缓冲区, 满了或 flush 时写出
     void log(const char *msg, size_t len) override
     {
-        if (_ofs.good())
+        if (_fd < 0)
         {
-            _ofs.write(msg, len);
+            std::cerr << "LogSink: Failed to write to file: " << _filename << std::endl;
+            return;
         }
-        else
+        if (!inBatch() || _buf.size() + len > kBufferSize)
+        {
+            flush();
+        }
+        if (!inBatch() || len >= kBufferSize)
+        {
+            detail::write_fd(_fd, msg, len);
+            return;
+        }
+        _buf.append(msg, len);
+    }
+
+    // 一批记录直接交给 writev, 不经过缓冲区
+    void logBatch(const RecordBatch &batch) override
+    {
+        if (_fd < 0)
         {
             std::cerr << "LogSink: Failed to write to file: " << _filename << std::endl;
+            return;
         }
+        flush();
+        detail::writev_fd(_fd, batch.iov, batch.count);
     }
 
     // 手动刷新缓冲区
     void flush() override
     {
-        if (_ofs.is_open()) 
+        if (_fd >= 0 && !_buf.empty())
         {
-            _ofs.flush();
+            detail::write_fd(_fd, _buf.data(), _buf.size());
+        }
+        _buf.clear();
+    }
+
+    void sync() override
+    {
+        flush();
+        if (_fd >= 0)
+        {
+            detail::sync_fd(_fd);
         }
     }
 
 private:
     std::string _filename;
-    std::ofstream _ofs;
+    int _fd = -1;
+    std::string _buf;
 };
 
 // 滚动文件落地（按大小滚动）
 class RollSink : public LogSink {
 public:
     using ptr = std::shared_ptr<RollSink>;
+
+    static constexpr size_t kBufferSize = 64 * 1024;
+
     RollSink(const std::string &basename, size_t max_size)
         : _basename(basename),
             _max_fsize(max_size),
@@ -160,54 +552,92 @@ public:
     {
         // Create parent dir from basename (basename may include a directory prefix)
         detail::ensure_parent_dir_exists(_basename);
+        _buf.reserve(kBufferSize);
     }
 
     ~RollSink() override
     {
-        if (_ofs.is_open()) 
-        {
-            _ofs.close();
-        }
+        closeFile();
     }
 
+    // 先攒在缓冲区, 满了或 flush 时写出
     void log(const char *data, size_t len) override
     {
         initLogFile();
 
-        if (_ofs.good())
+        if (_fd < 0)
         {
-            _ofs.write(data, len);
-            _cur_fsize += len;
+            std::cerr << "RollSink: Failed to write to log file" << std::endl;
+            return;
+        }
+        if (_buf.size() + len > kBufferSize)
+        {
+            flush();
+        }
+        if (len >= kBufferSize)
+        {
+            detail::write_fd(_fd, data, len);
         }
         else
         {
-            std::cerr << "RollSink: Failed to write to log file" << std::endl;
+            _buf.append(data, len);
         }
+        _cur_fsize += len;
     }
 
     // 手动刷新缓冲区
     void flush() override
     {
-        if (_ofs.is_open()) 
+        if (_fd >= 0 && !_buf.empty())
         {
-            _ofs.flush();
+            detail::write_fd(_fd, _buf.data(), _buf.size());
         }
+        _buf.clear();
+    }
+
+    // 同步当前文件. 调用过 sync 之后, 滚动或 reopen 关闭旧文件前也先同步, 否则 sync 只能覆盖当前文件
+    void sync() override
+    {
+        flush();
+        _durable = true;
+        if (_fd >= 0)
+        {
+            detail::sync_fd(_fd);
+        }
+    }
+
+    // 关闭当前文件, 下一次写入时重新打开一个带时间戳的新文件
+    void reopen() override
+    {
+        closeFile();
     }
 
 private:
+    void closeFile()
+    {
+        flush();
+        if (_fd >= 0)
+        {
+            if (_durable)
+            {
+                detail::sync_fd(_fd);
+            }
+            detail::close_fd(_fd);
+            _fd = -1;
+        }
+    }
+
     void initLogFile()
     {
         // 文件未打开 或 当前大小超过限制
-        if (!_ofs.is_open() || _cur_fsize >= _max_fsize)
+        if (_fd < 0 || _cur_fsize >= _max_fsize)
         {
-            if (_ofs.is_open()) {
-                _ofs.close();
-            }
+            closeFile();
 
             std::string name = createFilename();
-            _ofs.open(name, std::ios::binary | std::ios::app);
+            _fd = detail::open_append(name);
 
-            if (!_ofs.is_open()) {
+            if (_fd < 0) {
                 std::cerr << "RollSink: Failed to open file: " << name << std::endl;
                 return;
             }
@@ -235,9 +665,11 @@ private:
     }
 
     std::string _basename;
-    std::ofstream _ofs;
+    int _fd = -1;
+    std::string _buf;
     size_t _max_fsize;
     size_t _cur_fsize;
+    bool _durable = false;      // 调用过 sync
 };
 
 // 按时间滚动的文件落地（每日一个文件）
@@ -277,6 +709,16 @@ public:
         }
     }
 
+    void reopen() override
+    {
+        if (_ofs.is_open())
+        {
+            _ofs.close();
+        }
+        _ofs.clear();
+        initLogFile();
+    }
+
 private:
     void checkRoll()
     {
@@ -326,6 +768,452 @@ private:
     int _current_day;
 };
 
+// 内存飞行记录仪: 在环形字节缓冲里保留最近 capacity 字节的格式化输出, 不写磁盘.
+// 需要时整体导出: dump() 主动导出, dumpOnSignal() 收到 SIGUSR1 时导出, dumpOnCrash() 崩溃时导出.
+// 通常把 logger 开到 DEBUG, 同时挂一个只收 WARN 的文件 sink 和一个 RingSink.
+//
+// 写入不加锁: 先用 fetch_add 预留位置再拷贝, 按预留顺序推进 _committed(多个写者时
+// 后来者短暂等待前一个提交, 挂在同一个 logger 上时本就只有一个写者).
+// 读取也不阻塞写者: 快照复制 [_committed - capacity, _committed), 复制完再读一次 _reserved,
+// 期间被新写入覆盖的开头部分丢掉, 并从第一条完整的行开始.
+class RingSink : public LogSink {
+public:
+    using ptr = std::shared_ptr<RingSink>;
+
+    // capacity 向上取整到 2 的幂; dump_path 为 dump()/信号/崩溃时的导出文件
+    RingSink(size_t capacity, const std::string &dump_path)
+        : _capacity(roundUp(capacity)),
+            _buf(new char[_capacity]),
+            _dump_path(dump_path)
+    {
+        detail::ensure_parent_dir_exists(_dump_path);
+        registry().add(this);
+    }
+
+    ~RingSink() override
+    {
+        registry().remove(this);
+    }
+
+    size_t capacity() const { return _capacity; }
+
+    void log(const char *data, size_t len) override
+    {
+        if (len > _capacity)
+        {
+            data += len - _capacity;
+            len = _capacity;
+        }
+        uint64_t pos = _reserved.fetch_add(len, std::memory_order_relaxed);
+        copyIn(pos, data, len);
+        while (_committed.load(std::memory_order_acquire) != pos)
+        {
+            std::this_thread::yield();
+        }
+        _committed.store(pos + len, std::memory_order_release);
+    }
+
+    // 当前内容的一致快照, 从第一条完整的行开始
+    std::string snapshot() const
+    {
+        uint64_t end = _committed.load(std::memory_order_acquire);
+        uint64_t begin = end > _capacity ? end - _capacity : 0;
+        std::string out(static_cast<size_t>(end - begin), '\0');
+        copyOut(begin, &out[0], out.size());
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        uint64_t reserved = _reserved.load(std::memory_order_relaxed);
+        uint64_t safe = reserved > _capacity ? reserved - _capacity : 0;
+        size_t skip = safe > begin ? static_cast<size_t>(std::min<uint64_t>(safe - begin, out.size())) : 0;
+        if (skip > 0 || begin > 0)
+        {
+            size_t nl = out.find('\n', skip);
+            skip = nl == std::string::npos ? out.size() : nl + 1;
+        }
+        out.erase(0, skip);
+        return out;
+    }
+
+    // 快照写入文件(覆盖), 写者不受影响
+    bool dump(const std::string &path) const
+    {
+        detail::ensure_parent_dir_exists(path);
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+        std::string data = snapshot();
+        ofs.write(data.data(), static_cast<std::streamsize>(data.size()));
+        return ofs.good();
+    }
+
+    bool dump() const { return dump(_dump_path); }
+
+#ifndef _WIN32
+    // 收到 sig 时把所有 RingSink 导出到各自的 dump_path
+    static void dumpOnSignal(int sig = SIGUSR1)
+    {
+        struct sigaction sa;
+        std::memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = [](int) { dumpAllFromSignal(); };
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        ::sigaction(sig, &sa, nullptr);
+    }
+
+    // 崩溃(SIGSEGV/SIGBUS/SIGFPE/SIGILL/SIGABRT)时先导出, 再按默认方式结束进程
+    static void dumpOnCrash()
+    {
+        struct sigaction sa;
+        std::memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = [](int sig) {
+            dumpAllFromSignal();
+            ::raise(sig);
+        };
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESETHAND | SA_NODEFER;
+        for (int sig : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT})
+        {
+            ::sigaction(sig, &sa, nullptr);
+        }
+    }
+
+    // 只用异步信号安全的调用(open/write/close), 可在自己的崩溃处理函数里调用.
+    // 不等待也不分配内存: 直接写出已提交的部分, 跳过可能正被覆盖的开头
+    static void dumpAllFromSignal()
+    {
+        Registry &reg = registry();
+        for (auto &slot : reg.slots)
+        {
+            RingSink *sink = slot.load(std::memory_order_acquire);
+            if (sink)
+            {
+                sink->dumpFromSignal();
+            }
+        }
+    }
+#endif
+
+private:
+    // 已注册的 RingSink, 供信号处理函数遍历; 超出容量的不参与信号导出
+    struct Registry {
+        static constexpr size_t kSlots = 16;
+        std::atomic<RingSink *> slots[kSlots] = {};
+
+        void add(RingSink *sink)
+        {
+            for (auto &slot : slots)
+            {
+                RingSink *expected = nullptr;
+                if (slot.compare_exchange_strong(expected, sink))
+                    return;
+            }
+        }
+
+        void remove(RingSink *sink)
+        {
+            for (auto &slot : slots)
+            {
+                RingSink *expected = sink;
+                if (slot.compare_exchange_strong(expected, nullptr))
+                    return;
+            }
+        }
+    };
+
+    static Registry &registry()
+    {
+        static Registry reg;
+        return reg;
+    }
+
+    static size_t roundUp(size_t n)
+    {
+        size_t cap = 4096;
+        while (cap < n)
+            cap <<= 1;
+        return cap;
+    }
+
+    void copyIn(uint64_t pos, const char *data, size_t len)
+    {
+        size_t off = static_cast<size_t>(pos & (_capacity - 1));
+        size_t first = std::min(len, _capacity - off);
+        std::memcpy(_buf.get() + off, data, first);
+        std::memcpy(_buf.get(), data + first, len - first);
+    }
+
+    void copyOut(uint64_t pos, char *out, size_t len) const
+    {
+        size_t off = static_cast<size_t>(pos & (_capacity - 1));
+        size_t first = std::min(len, _capacity - off);
+        std::memcpy(out, _buf.get() + off, first);
+        std::memcpy(out + first, _buf.get(), len - first);
+    }
+
+#ifndef _WIN32
+    void dumpFromSignal() const
+    {
+        int fd = ::open(_dump_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return;
+        uint64_t end = _committed.load(std::memory_order_acquire);
+        uint64_t reserved = _reserved.load(std::memory_order_relaxed);
+        // 写出期间其他线程可能继续写入, 额外让出 1/8 的空间
+        uint64_t lag = reserved - end + _capacity / 8;
+        if (lag >= _capacity)
+        {
+            ::close(fd);
+            return;
+        }
+        uint64_t begin = end > _capacity - lag ? end - (_capacity - lag) : 0;
+        while (begin < end && begin > 0 && _buf[begin & (_capacity - 1)] != '\n')
+            ++begin;
+        if (begin > 0 && begin < end)
+            ++begin;
+        while (begin < end)
+        {
+            size_t off = static_cast<size_t>(begin & (_capacity - 1));
+            size_t n = static_cast<size_t>(std::min<uint64_t>(end - begin, _capacity - off));
+            ssize_t w = ::write(fd, _buf.get() + off, n);
+            if (w <= 0)
+                break;
+            begin += static_cast<uint64_t>(w);
+        }
+        ::close(fd);
+    }
+#endif
+
+    const size_t _capacity;
+    std::unique_ptr<char[]> _buf;
+    std::string _dump_path;
+    std::atomic<uint64_t> _reserved{0};     // 已预留到的位置(单调递增)
+    std::atomic<uint64_t> _committed{0};    // 已写完的位置, 之前的字节都可读
+};
+
+// 按记录的键把日志分到不同文件, 路径模板中的 {} 替换为键:
+//   RoutingFileSink("./logs/tenant/{}.log", "tenant")   键取线程上下文(ScopedContext) tenant 的值
+//   RoutingFileSink("./logs/{}.log")                    键为 logger 名称
+// 字段值取自记录携带的上下文原值, 与格式化器无关, 也不会被消息正文里的 "tenant=..." 冒充; 取不到时键为 default.
+// 键中路径不安全的字符替换为 '_'. 打开的文件按最近使用保留最多 max_open 个, 超出时关闭最久未用的;
+// 后台线程定期关闭空闲超过 idle_close 的文件. 异步 logger 的一批记录按文件攒在内存里, 批末每个文件一次 write.
+class RoutingFileSink : public LogSink {
+public:
+    using ptr = std::shared_ptr<RoutingFileSink>;
+
+    static constexpr size_t kDefaultMaxOpen = 64;
+    static constexpr size_t kFileBufferSize = 64 * 1024;    // 单个文件批内最多攒这么多
+
+    RoutingFileSink(const std::string &pattern,
+                    const std::string &field = "",
+                    size_t max_open = kDefaultMaxOpen,
+                    std::chrono::milliseconds idle_close = std::chrono::seconds(60))
+        : _pattern(pattern),
+            _field(field),
+            _max_open(max_open == 0 ? 1 : max_open),
+            _idle_close(idle_close)
+    {
+        if (_pattern.find("{}") == std::string::npos)
+        {
+            throw std::runtime_error("RoutingFileSink: path pattern needs {}: " + _pattern);
+        }
+        if (_idle_close.count() > 0)
+        {
+            _closer = std::thread([this]() { closeIdleLoop(); });
+        }
+    }
+
+    ~RoutingFileSink() override
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _running = false;
+        }
+        _cv.notify_all();
+        if (_closer.joinable())
+        {
+            _closer.join();
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!_lru.empty())
+        {
+            closeFile(_lru.back());
+        }
+    }
+
+    bool perRecord() const override { return true; }
+
+    bool wantsContext() const override { return !_field.empty(); }
+
+    void logRecord(const RecordView &rec) override
+    {
+        std::string_view key = rec.logger;
+        if (!_field.empty() && !context::find(rec.context, _field, key))
+            key = std::string_view();
+        bool batching = inBatch();
+        std::unique_lock<std::mutex> lock(_mutex);
+        File &file = acquire(key);
+        file.buf.append(rec.data, rec.len);
+        if (!batching || file.buf.size() >= kFileBufferSize)
+        {
+            writeOut(file);
+        }
+    }
+
+    // 没有记录边界与元数据的整段字节写入 default
+    void log(const char *data, size_t len) override
+    {
+        bool batching = inBatch();
+        std::unique_lock<std::mutex> lock(_mutex);
+        File &file = acquire(std::string_view());
+        file.buf.append(data, len);
+        if (!batching || file.buf.size() >= kFileBufferSize)
+        {
+            writeOut(file);
+        }
+    }
+
+    void flush() override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (File *file : _lru)
+        {
+            writeOut(*file);
+        }
+    }
+
+    // fork 后的子进程关掉继承来的描述符, 下次写入时重新打开
+    void reopen() override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!_lru.empty())
+        {
+            closeFile(_lru.back());
+        }
+    }
+
+    size_t openFiles()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _lru.size();
+    }
+
+    // 累计打开文件的次数(含被淘汰后重新打开)
+    uint64_t opened() const { return _opened.load(std::memory_order_relaxed); }
+
+    // 路径模板中的 {} 替换为处理过的键
+    std::string pathFor(std::string_view key) const
+    {
+        std::string safe;
+        for (char c : key.substr(0, 128))
+        {
+            bool ok = std::isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '-' || c == '_';
+            safe.push_back(ok ? c : '_');
+        }
+        if (safe.empty() || safe == "." || safe == "..")
+            safe = "default";
+        std::string path = _pattern;
+        path.replace(path.find("{}"), 2, safe);
+        return path;
+    }
+
+private:
+    struct File {
+        std::string path;
+        int fd = -1;
+        std::string buf;
+        std::chrono::steady_clock::time_point last_used;
+        std::list<File *>::iterator pos;
+    };
+
+    File &acquire(std::string_view key)
+    {
+        std::string path = pathFor(key);
+        auto it = _files.find(path);
+        if (it != _files.end())
+        {
+            File &file = it->second;
+            _lru.splice(_lru.begin(), _lru, file.pos);
+            file.last_used = std::chrono::steady_clock::now();
+            if (file.fd < 0)
+            {
+                openFile(file);
+            }
+            return file;
+        }
+        while (_lru.size() >= _max_open)
+        {
+            closeFile(_lru.back());
+        }
+        File &file = _files[path];
+        file.path = path;
+        file.last_used = std::chrono::steady_clock::now();
+        _lru.push_front(&file);
+        file.pos = _lru.begin();
+        openFile(file);
+        return file;
+    }
+
+    void openFile(File &file)
+    {
+        detail::ensure_parent_dir_exists(file.path);
+        file.fd = detail::open_append(file.path);
+        if (file.fd < 0)
+        {
+            std::cerr << "LogSink: Failed to open log file: " << file.path << std::endl;
+        }
+        _opened.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void writeOut(File &file)
+    {
+        if (file.buf.empty())
+            return;
+        if (file.fd >= 0)
+        {
+            detail::write_fd(file.fd, file.buf.data(), file.buf.size());
+        }
+        file.buf.clear();
+    }
+
+    void closeFile(File *file)
+    {
+        writeOut(*file);
+        if (file->fd >= 0)
+        {
+            detail::close_fd(file->fd);
+        }
+        _lru.erase(file->pos);
+        _files.erase(file->path);
+    }
+
+    void closeIdleLoop()
+    {
+        util::thread::setName("ylog-route");
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto interval = std::max<std::chrono::milliseconds>(_idle_close / 2, std::chrono::milliseconds(10));
+        while (_running)
+        {
+            _cv.wait_for(lock, interval, [this]() { return !_running; });
+            auto now = std::chrono::steady_clock::now();
+            while (!_lru.empty() && now - _lru.back()->last_used >= _idle_close)
+            {
+                closeFile(_lru.back());
+            }
+        }
+    }
+
+    std::string _pattern;
+    std::string _field;
+    size_t _max_open;
+    std::chrono::milliseconds _idle_close;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::unordered_map<std::string, File> _files;
+    std::list<File *> _lru;                 // 最近使用的在前
+    bool _running = true;
+    std::atomic<uint64_t> _opened{0};
+    std::thread _closer;
+};
+
 // 工厂模式：创建不同类型的 Sink
 class SinkFactory {
 public:
@@ -2,13 +2,35 @@
 #include "loggerMgr.hpp"
 #include "sink.hpp"
 #include "loggerFormat.hpp"
+#include "shm.hpp"
+#include "net.hpp"
 #include <iostream>
 #include <thread>
 #include <vector>
 #include <chrono>
+#include <fstream>
+#include <string>
+#include <sstream>
+#include <cstdio>
+#include <csignal>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#endif
 
 using namespace YLog;
 
+// 与 DetailFormat 输出相同的模式串, 编译期解析
+static constexpr char kDetailPattern[] = "[%Y/%m/%d %H:%M:%S][%n][%l] %v";
+
 int main()
 {
     // ==================== 多线程异步日志测试 ====================
@@ -46,6 +68,283 @@ int main()
         std::this_thread::sleep_for(std::chrono::milliseconds(200));
     }
 
+    // ==================== 超大日志与普通日志混合写入 ====================
+    // 目标：远超缓冲区大小(1MB)的单条日志不会卡住生产者, 每条都完整落盘.
+    // 超过 64KB 但放得进缓冲区剩余空间的日志仍写在缓冲区内, 同样完整落盘.
+    {
+        util::file::remove("./logs/async_large.log");
+
+        LoggerBuilder large_builder;
+        large_builder.buildLoggerName("async_large");
+        large_builder.buildLoggerType(Logger::Type::LOGGER_ASYNC);
+        large_builder.buildSink<FileSink>("./logs/async_large.log");
+        auto large_logger = large_builder.build();
+
+        constexpr int kLargeCount = 4;
+        constexpr size_t kLargeSize = 16 * 1024 * 1024;
+        constexpr size_t kMediumSize = 200 * 1024;
+        constexpr int kNormalThreads = 4;
+        constexpr int kNormalPerThread = 20000;
+
+        const std::string payload(kLargeSize, 'x');
+        const std::string medium(kMediumSize, 'm');
+        std::vector<std::thread> threads;
+        threads.emplace_back([large_logger, &payload, &medium]() {
+            for (int i = 0; i < kLargeCount; ++i)
+            {
+                logi(large_logger, "large i={}, payload={}", i, payload);
+                logi(large_logger, "medium i={}, payload={}", i, medium);
+            }
+        });
+        for (int t = 0; t < kNormalThreads; ++t)
+        {
+            threads.emplace_back([large_logger, t]() {
+                for (int i = 0; i < kNormalPerThread; ++i)
+                    logi(large_logger, "normal tid={}, i={}", t, i);
+            });
+        }
+        for (auto &th : threads)
+            th.join();
+        large_logger.reset();   // 析构时排空队列
+
+        std::ifstream ifs("./logs/async_large.log");
+        int large_lines = 0, medium_lines = 0, normal_lines = 0;
+        for (std::string line; std::getline(ifs, line);)
+        {
+            if (line.find("large i=") != std::string::npos && line.size() > kLargeSize)
+                ++large_lines;
+            else if (line.find("medium i=") != std::string::npos && line.size() > kMediumSize)
+                ++medium_lines;
+            else if (line.find("normal tid=") != std::string::npos)
+                ++normal_lines;
+        }
+        bool ok = large_lines == kLargeCount && medium_lines == kLargeCount
+            && normal_lines == kNormalThreads * kNormalPerThread;
+        std::cout << "large message test: large " << large_lines << ", medium " << medium_lines << ", normal "
+                  << normal_lines
+                  << (ok ? " OK" : " FAILED") << std::endl;
+    }
+
+    // 超大日志在锁外格式化: 格式化期间其他线程照常入队不等待, 超大日志按提交时排在它们之后
+    {
+        constexpr size_t kHuge = 2 * BUFFER_DEFAULT_SIZE;
+        std::vector<std::string> order;
+        AsyncWorker worker([&](Buffer &buf) {
+            for (const Record &rec : buf.records())
+                order.emplace_back(buf.data(rec), std::min<size_t>(rec.len, 5));
+        });
+        std::atomic<bool> formatting{false};
+        std::thread huge([&]() {
+            worker.pushWith(LogLevel::Value::INFO, {}, kHuge,
+                            [&](char *out, size_t cap, AsyncWorker::clock::time_point) {
+                                formatting = true;
+                                std::this_thread::sleep_for(std::chrono::milliseconds(300));
+                                std::memset(out, 'H', std::min(cap, kHuge));
+                                return kHuge;
+                            });
+        });
+        while (!formatting.load())
+            std::this_thread::yield();
+        auto start = std::chrono::steady_clock::now();
+        worker.push("small\n");
+        auto cost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        huge.join();
+        worker.stop();
+        bool ok = cost.count() < 100 && order.size() == 2 && order[0] == "small" && order[1] == "HHHHH";
+        std::cout << "huge record formatted unlocked: small push took " << cost.count() << "ms"
+                  << (ok ? " OK" : " FAILED") << std::endl;
+    }
+
+    // 预估长度(与 AsyncLogger 相同: 格式串长度 + 余量)远小于实际长度且缓冲区剩余空间不足: 第一次写入不提交,
+    // 等后台线程腾出空间后按实际长度重写一次. 记录完整, 只出现一次, 排在之前的记录之后
+    {
+        std::mutex gate_mutex;
+        std::condition_variable gate_cv;
+        bool gate_open = false, entered = false;
+        std::vector<std::string> out;
+        AsyncWorker worker([&](Buffer &buf) {
+            std::unique_lock<std::mutex> lock(gate_mutex);
+            entered = true;
+            gate_cv.notify_all();
+            gate_cv.wait(lock, [&]() { return gate_open; });
+            for (const Record &rec : buf.records())
+                out.emplace_back(buf.data(rec), rec.len);
+        });
+        worker.push("first\n");
+        {
+            // 后台线程拿走第一批后停在回调里, 此后写入的都留在同一块 push 缓冲区
+            std::unique_lock<std::mutex> lock(gate_mutex);
+            gate_cv.wait(lock, [&]() { return entered; });
+        }
+        constexpr size_t kSpare = 1000;
+        const size_t fill = BUFFER_DEFAULT_SIZE - kSpare;
+        worker.pushWith(LogLevel::Value::INFO, {}, fill, [&](char *dst, size_t cap, AsyncWorker::clock::time_point) {
+            std::memset(dst, 'f', std::min(cap, fill));
+            return fill;
+        });
+
+        const std::string fmt_text = "long {}";
+        std::string body = "long ";
+        for (int i = 0; body.size() < 5000; ++i)
+            body += std::to_string(i) + ",";
+        body += "\n";
+        std::atomic<int> calls{0};
+        std::thread writer([&]() {
+            worker.pushWith(LogLevel::Value::INFO, {}, fmt_text.size() + AsyncLogger::kEstimatePadding,
+                            [&](char *dst, size_t cap, AsyncWorker::clock::time_point) {
+                                calls.fetch_add(1);
+                                std::memcpy(dst, body.data(), std::min(cap, body.size()));
+                                return body.size();
+                            });
+        });
+        // 第一次写入发现放不下, 等待腾出空间
+        while (calls.load() == 0)
+            std::this_thread::yield();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        bool waited = calls.load() == 1;
+        {
+            std::unique_lock<std::mutex> lock(gate_mutex);
+            gate_open = true;
+            gate_cv.notify_all();
+        }
+        writer.join();
+        worker.stop();
+
+        size_t copies = std::count(out.begin(), out.end(), body);
+        bool ok = waited && calls.load() == 2 && out.size() == 3 && out[0] == "first\n" && out[1].size() == fill
+            && out[2] == body && copies == 1;
+        std::cout << "undersized estimate: " << body.size() << " bytes written " << calls.load() << " times, "
+                  << copies << " copy in output" << (ok ? " OK" : " FAILED") << std::endl;
+    }
+
+    // 慢 sink 被 INFO 压满、生产者在背压中等待时, 另一线程写 ERROR 走高优先级通道立即返回;
+    // 输出时两个通道按序号归并: ERROR 排在它之前已提交的 INFO 之后, 每条 INFO 恰好一次且有序
+    {
+        struct SlowSink : public LogSink {
+            std::mutex mutex;
+            std::vector<std::string> lines;
+
+            void log(const char *data, size_t len) override
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                lines.emplace_back(data, len);
+            }
+            void logBatch(const RecordBatch &batch) override
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                std::unique_lock<std::mutex> lock(mutex);
+                for (size_t i = 0; i < batch.count; ++i)
+                    lines.emplace_back(batch.records[i].data, batch.records[i].len);
+            }
+        };
+        auto slow = std::make_shared<SlowSink>();
+        std::vector<LogSink::ptr> sinks{slow};
+        Logger::ptr pressured = std::make_shared<AsyncLogger>("urgent", sinks, LogLevel::Value::DEBUG,
+                                                              std::make_shared<NormalFormat>());
+        constexpr int kInfo = 3000;
+        const std::string filler(1000, 'i');
+        std::atomic<int> committed{0};
+        std::thread producer([&]() {
+            for (int i = 0; i < kInfo; ++i)
+            {
+                logi(pressured, "info i={} {}", i, filler);
+                committed.store(i + 1);
+            }
+        });
+        // 等生产者停在背压上: 提交数 50ms 内不再增长
+        int before = -1;
+        while (before != committed.load())
+        {
+            before = committed.load();
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        std::chrono::milliseconds cost{0};
+        std::thread urgent([&]() {
+            auto start = std::chrono::steady_clock::now();
+            loge(pressured, "error while saturated");
+            cost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        });
+        urgent.join();
+        bool stalled = committed.load() < kInfo;
+        producer.join();
+        pressured.reset();
+
+        int next = 0, error_at = -1, error_count = 0;
+        bool ordered = true;
+        for (size_t i = 0; i < slow->lines.size(); ++i)
+        {
+            const std::string &line = slow->lines[i];
+            if (line.find("error while saturated") != std::string::npos)
+            {
+                error_at = next;
+                ++error_count;
+                continue;
+            }
+            ordered = ordered && line.find("info i=" + std::to_string(next) + " ") != std::string::npos;
+            ++next;
+        }
+        // error_at 为 ERROR 之前输出的 INFO 条数, 至少包含调用前已提交的 before 条
+        bool ok = stalled && cost.count() < 100 && ordered && next == kInfo && error_count == 1 && error_at >= before;
+        std::cout << "urgent lane under backpressure: error took " << cost.count() << "ms, after " << error_at
+                  << " of " << before << " committed infos" << (ok ? " OK" : " FAILED") << std::endl;
+    }
+
+#ifndef _WIN32
+    // ==================== fork 后子进程继续异步写日志 ====================
+    // 目标：父进程持续写日志时 fork, 子进程无需额外初始化即可写入, 且不会死锁或丢日志.
+    {
+        util::file::remove("./logs/fork.log");
+
+        LoggerBuilder fork_builder;
+        fork_builder.buildLoggerName("fork");
+        fork_builder.buildLoggerType(Logger::Type::LOGGER_ASYNC);
+        fork_builder.buildReopenOnFork(true);
+        fork_builder.buildSink<FileSink>("./logs/fork.log");
+        auto fork_logger = fork_builder.build();
+
+        constexpr int kChildren = 3;
+        constexpr int kPerChild = 1000;
+
+        // 后台线程只借用裸指针, 否则 fork 瞬间它持有的 shared_ptr 副本会让子进程中的 logger 无法析构
+        Logger *raw = fork_logger.get();
+        std::atomic<bool> stop{false};
+        std::thread noise([raw, &stop]() {
+            for (int i = 0; !stop; ++i)
+                raw->info("parent i={}", i);
+        });
+
+        std::vector<pid_t> children;
+        for (int c = 0; c < kChildren; ++c)
+        {
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                for (int i = 0; i < kPerChild; ++i)
+                    logi(fork_logger, "fork child={}, i={}", c, i);
+                fork_logger.reset();    // 析构时排空队列
+                _exit(0);
+            }
+            children.push_back(pid);
+        }
+        for (pid_t pid : children)
+            waitpid(pid, nullptr, 0);
+
+        stop = true;
+        noise.join();
+        fork_logger.reset();    // 父进程也排空后再读文件
+
+        std::ifstream ifs("./logs/fork.log");
+        int child_lines = 0;
+        for (std::string line; std::getline(ifs, line);)
+        {
+            if (line.find("fork child=") != std::string::npos)
+                ++child_lines;
+        }
+        std::cout << "fork test: child lines " << child_lines << " / " << kChildren * kPerChild
+                  << (child_lines == kChildren * kPerChild ? " OK" : " FAILED") << std::endl;
+    }
+#endif
+
     // 创建 LoggerBuilder（会自动注册到 LoggerMgr）
     LoggerBuilder builder;
 
@@ -88,6 +387,1419 @@ int main()
     logw("字符串: {}, 字符: {}", "hello", 'A');
     loge("指针: {:p}", (const void*)&main);
 
+    std::cout << "\n========== 结构化日志 ==========\n" << std::endl;
+
+    // 字段直接编码为 JSON / logfmt, 同步与异步路径一致
+    for (auto format : {LoggerFormat::FormatType::FORMAT_JSON, LoggerFormat::FormatType::FORMAT_LOGFMT})
+    {
+        LoggerBuilder kv_builder;
+        kv_builder.buildLoggerName("orders");
+        kv_builder.buildLoggerType(Logger::Type::LOGGER_SYNC);
+        kv_builder.buildLoggerFormat(format);
+        kv_builder.buildSink<StdoutSink>();
+        auto kv_logger = kv_builder.build();
+
+        int order_id = 1001;
+        double cost_ms = 12.5;
+        std::string user = "alice \"admin\"";
+        kv_logger->info("order placed", kv("id", order_id), kv("ms", cost_ms), kv("user", user), kv("paid", true));
+        logw(kv_logger, "库存不足", kv("sku", "A-01"), kv("left", 0));
+    }
+
+    std::cout << "\n========== 线程上下文 ==========\n" << std::endl;
+
+    // ScopedContext 随作用域附加到本线程的日志, 内层同名键覆盖外层, 其他线程不受影响
+    {
+        util::file::remove("./logs/context.log");
+        LoggerBuilder ctx_builder;
+        ctx_builder.buildLoggerName("context");
+        ctx_builder.buildLoggerType(Logger::Type::LOGGER_ASYNC);
+        ctx_builder.buildLoggerFormat(LoggerFormat::FormatType::FORMAT_DETAIL);
+        ctx_builder.buildSink<FileSink>("./logs/context.log");
+        auto ctx_logger = ctx_builder.build();
+        {
+            ScopedContext req{"req", 42};
+            logi(ctx_logger, "one field");
+            {
+                ScopedContext tenant{"tenant", "acme corp"};
+                ScopedContext inner{"req", "42-retry"};
+                logi(ctx_logger, "nested");
+                std::thread([&]() { logi(ctx_logger, "other thread"); }).join();
+            }
+            logi(ctx_logger, "back to one");
+        }
+        logi(ctx_logger, "no context");
+        ctx_logger.reset();
+
+        const char *expected[] = {
+            "[INFO ] [req=42] one field",
+            "[INFO ] [tenant=\"acme corp\" req=42-retry] nested",
+            "[INFO ] other thread",
+            "[INFO ] [req=42] back to one",
+            "[INFO ] no context",
+        };
+        std::ifstream ifs("./logs/context.log");
+        std::vector<std::string> lines;
+        for (std::string line; std::getline(ifs, line);)
+            lines.push_back(line);
+        bool ok = lines.size() == 5;
+        for (size_t i = 0; ok && i < lines.size(); ++i)
+        {
+            const std::string &want = expected[i];
+            ok = lines[i].size() >= want.size() && lines[i].compare(lines[i].size() - want.size(), want.size(), want) == 0;
+            std::cout << "  " << lines[i] << std::endl;
+        }
+        std::cout << "context: " << lines.size() << " lines" << (ok ? " OK" : " FAILED") << std::endl;
+
+        // JSON / logfmt 中上下文作为普通字段
+        ScopedContext req{"req", 7};
+        for (auto format : {LoggerFormat::FormatType::FORMAT_JSON, LoggerFormat::FormatType::FORMAT_LOGFMT})
+        {
+            LoggerBuilder kv_builder;
+            kv_builder.buildLoggerName("context_kv");
+            kv_builder.buildLoggerType(Logger::Type::LOGGER_SYNC);
+            kv_builder.buildLoggerFormat(format);
+            kv_builder.buildSink<StdoutSink>();
+            auto kv_logger = kv_builder.build();
+            YLOG_INFO(kv_logger, "with context", kv("id", 1));
+        }
+    }
+
+    std::cout << "\n========== 调用点限流 ==========\n" << std::endl;
+
+    // 放行条数 + 报告的 suppressed 总数应等于调用总数(最后一段未报告的除外)
+    {
+        util::file::remove("./logs/limit.log");
+        // 不经过 LoggerMgr 注册, 读文件前手动 flush
+        std::vector<LogSink::ptr> limit_sinks{std::make_shared<FileSink>("./logs/limit.log")};
+        Logger::ptr limit_logger = std::make_shared<SyncLogger>("limit", limit_sinks);
+
+        constexpr int kCalls = 100000;
+        int evaluated = 0;
+        auto expensive = [&evaluated]() { return ++evaluated; };
+        for (int i = 0; i < kCalls; ++i)
+            YLOG_INFO_EVERY_N(limit_logger, 1000, "every_n i={} eval={}", i, expensive());
+        for (int i = 0; i < kCalls; ++i)
+            YLOG_WARN_SAMPLED(limit_logger, 0.01, "sampled i={}", i);
+        auto start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(100))
+            YLOG_ERROR_EVERY_MS(limit_logger, 10, "every_ms");
+        limit_sinks[0]->flush();
+
+        std::ifstream ifs("./logs/limit.log");
+        long lines[3] = {0, 0, 0};
+        long suppressed[3] = {0, 0, 0};
+        const char *tags[3] = {"every_n", "sampled", "every_ms"};
+        for (std::string line; std::getline(ifs, line);)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                if (line.find(tags[k]) == std::string::npos)
+                    continue;
+                ++lines[k];
+                size_t pos = line.find("suppressed=");
+                if (pos != std::string::npos)
+                    suppressed[k] += std::stol(line.substr(pos + 11));
+                break;
+            }
+        }
+        bool ok = lines[0] == kCalls / 1000 && lines[0] + suppressed[0] == kCalls - 999 && evaluated == lines[0];
+        std::cout << "every_n: lines " << lines[0] << ", suppressed " << suppressed[0]
+                  << ", args evaluated " << evaluated << (ok ? " OK" : " FAILED") << std::endl;
+        std::cout << "sampled(0.01): lines " << lines[1] << ", suppressed " << suppressed[1] << std::endl;
+        std::cout << "every_ms(10) for 100ms: lines " << lines[2] << ", suppressed " << suppressed[2] << std::endl;
+    }
+
+    // 限流宏带结构化字段: 用户字段原样编码, suppressed 跟在后面, 第一条没有 suppressed
+    {
+        util::file::remove("./logs/limit_kv.log");
+        std::vector<LogSink::ptr> kv_sinks{std::make_shared<FileSink>("./logs/limit_kv.log")};
+        Logger::ptr kv_logger = std::make_shared<SyncLogger>("limit_kv", kv_sinks, LogLevel::Value::DEBUG,
+                                                             std::make_shared<JsonFormat>("limit_kv"));
+        for (int i = 0; i < 30; ++i)
+            YLOG_WARN_EVERY_N(kv_logger, 10, "slow query", kv("ms", i), kv("table", "orders"));
+        YLOG_INFO_EVERY_MS(kv_logger, 1000, "db down", kv("retry", 1));
+        YLOG_DEBUG_SAMPLED(kv_logger, 1.0, "req", kv("id", 7));
+        kv_sinks[0]->flush();
+
+        std::ifstream ifs("./logs/limit_kv.log");
+        std::vector<std::string> lines;
+        for (std::string line; std::getline(ifs, line);)
+            lines.push_back(line);
+        bool ok = lines.size() == 5
+            && lines[0].find("\"ms\":0,\"table\":\"orders\"") != std::string::npos
+            && lines[0].find("suppressed") == std::string::npos
+            && lines[1].find("\"ms\":10,\"table\":\"orders\",\"suppressed\":9") != std::string::npos
+            && lines[2].find("\"ms\":20,\"table\":\"orders\",\"suppressed\":9") != std::string::npos
+            && lines[3].find("\"retry\":1") != std::string::npos
+            && lines[4].find("\"id\":7") != std::string::npos;
+        std::cout << "limited kv: " << lines.size() << " lines" << (ok ? " OK" : " FAILED") << std::endl;
+        for (auto &line : lines)
+            std::cout << "  " << line << std::endl;
+    }
+
+    std::cout << "\n========== 重复日志折叠 ==========\n" << std::endl;
+
+    // 1000 条相同 + 1 条不同 + 3 条相同 => 原文 3 行 + 汇总 2 行, 同步与异步一致
+    for (auto type : {Logger::Type::LOGGER_SYNC, Logger::Type::LOGGER_ASYNC})
+    {
+        const char *path = type == Logger::Type::LOGGER_SYNC ? "./logs/repeat_sync.log" : "./logs/repeat_async.log";
+        util::file::remove(path);
+        {
+            LoggerBuilder repeat_builder;
+            repeat_builder.buildLoggerName("repeat");
+            repeat_builder.buildLoggerType(type);
+            repeat_builder.buildLoggerFormat(LoggerFormat::FormatType::FORMAT_DETAIL);
+            repeat_builder.buildRepeatWindow(std::chrono::milliseconds(10000));
+            repeat_builder.buildSink<FileSink>(path);
+            auto repeat_logger = repeat_builder.build();
+
+            for (int i = 0; i < 1000; ++i)
+                logw(repeat_logger, "dependency down: {}", "db");
+            logi(repeat_logger, "dependency up");
+            for (int i = 0; i < 3; ++i)
+                logw(repeat_logger, "dependency down: {}", "db");
+        }   // 析构时补上最后一段汇总
+
+        std::ifstream ifs(path);
+        std::vector<std::string> lines;
+        for (std::string line; std::getline(ifs, line);)
+            lines.push_back(line);
+        bool ok = lines.size() == 5
+            && lines[1].find("last message repeated 999 times") != std::string::npos
+            && lines[2].find("dependency up") != std::string::npos
+            && lines[4].find("last message repeated 2 times") != std::string::npos;
+        std::cout << path << ": " << lines.size() << " lines" << (ok ? " OK" : " FAILED") << std::endl;
+        for (auto &line : lines)
+            std::cout << "  " << line << std::endl;
+    }
+
+    std::cout << "\n========== 回溯 ==========\n" << std::endl;
+
+    // 以 INFO 运行, DEBUG 只进回溯; ERROR 出现时先输出最近 4 条 DEBUG, 再输出 ERROR.
+    // 回溯记录交给 sink 时带着自己的等级与等级字段位置, 而不是触发记录的
+    struct LevelSink : public LogSink {
+        std::mutex mutex;
+        std::vector<std::string> levels;
+
+        bool perRecord() const override { return true; }
+        void log(const char *, size_t) override {}
+        void logRecord(const RecordView &rec) override
+        {
+            std::string level = LogLevel::toString(rec.level);
+            bool located = rec.level_pos != kNoLevelPos
+                && std::string(rec.data + rec.level_pos, std::min(level.size(), rec.len - rec.level_pos)) == level;
+            std::unique_lock<std::mutex> lock(mutex);
+            levels.push_back(located ? level : level + "?");
+        }
+    };
+    for (auto type : {Logger::Type::LOGGER_SYNC, Logger::Type::LOGGER_ASYNC})
+    {
+        bool async = type == Logger::Type::LOGGER_ASYNC;
+        std::string path = async ? "./logs/backtrace_async.log" : "./logs/backtrace_sync.log";
+        util::file::remove(path);
+        auto level_sink = std::make_shared<LevelSink>();
+        Logger::ptr bt_logger;
+        {
+            // builder 也持有 sink, 出作用域后 logger 析构时才会关闭文件
+            LoggerBuilder bt_builder;
+            bt_builder.buildLoggerName("backtrace");
+            bt_builder.buildLoggerType(type);
+            bt_builder.buildLoggerLevel(LogLevel::Value::INFO);
+            bt_builder.buildLoggerFormat(LoggerFormat::FormatType::FORMAT_DETAIL);
+            bt_builder.buildSink<FileSink>(path);
+            bt_builder.buildSink(level_sink);
+            bt_logger = bt_builder.build();
+        }
+        bt_logger->enableBacktrace(4);
+
+        for (int i = 0; i < 6; ++i)
+            logd(bt_logger, "step {}", i);
+        logi(bt_logger, "request started");
+        loge(bt_logger, "request failed");
+        loge(bt_logger, "second error, nothing buffered");
+        logd(bt_logger, "step {}", 6);
+        bt_logger->disableBacktrace();
+        logd(bt_logger, "dropped");
+        logw(bt_logger, "done");
+        bt_logger.reset();
+
+        const char *expected[] = {"request started", "step 2", "step 3", "step 4", "step 5",
+                                  "request failed", "second error, nothing buffered", "done"};
+        std::ifstream ifs(path);
+        std::vector<std::string> lines;
+        for (std::string line; std::getline(ifs, line);)
+            lines.push_back(line);
+        const char *expected_levels[] = {"INFO", "DEBUG", "DEBUG", "DEBUG", "DEBUG", "ERROR", "ERROR", "WARN"};
+        bool ok = lines.size() == 8 && level_sink->levels.size() == 8;
+        for (size_t i = 0; ok && i < lines.size(); ++i)
+            ok = lines[i].find(std::string("] ") + expected[i]) != std::string::npos
+                && level_sink->levels[i] == expected_levels[i];
+        std::cout << path << ": " << lines.size() << " lines, levels";
+        for (auto &level : level_sink->levels)
+            std::cout << " " << level;
+        std::cout << (ok ? " OK" : " FAILED") << std::endl;
+        for (auto &line : lines)
+            std::cout << "  " << line << std::endl;
+    }
+
+    // 同步 logger 上一个线程反复调整回溯, 另一个线程不断触发回溯输出, 两者的加锁顺序不能相反
+    {
+        LoggerBuilder bt_builder;
+        bt_builder.buildLoggerName("backtrace_race");
+        bt_builder.buildLoggerLevel(LogLevel::Value::INFO);
+        bt_builder.buildSink<FileSink>("/dev/null");
+        auto bt_logger = bt_builder.build();
+        bt_logger->enableBacktrace(8);
+
+        constexpr int kRounds = 20000;
+        std::thread reconfig([&]() {
+            for (int i = 0; i < kRounds; ++i)
+                bt_logger->enableBacktrace(8 + i % 4);
+        });
+        for (int i = 0; i < kRounds; ++i)
+        {
+            for (int j = 0; j < 8; ++j)
+                logd(bt_logger, "step {}.{}", i, j);
+            loge(bt_logger, "failed {}", i);
+        }
+        reconfig.join();
+        // 门限随等级与回溯等级一起变化
+        bool gate = bt_logger->shouldLog(LogLevel::Value::DEBUG);
+        bt_logger->disableBacktrace();
+        gate = gate && !bt_logger->shouldLog(LogLevel::Value::DEBUG) && bt_logger->shouldLog(LogLevel::Value::INFO);
+        bt_logger->setLevel(LogLevel::Value::ERROR);
+        gate = gate && !bt_logger->shouldLog(LogLevel::Value::WARN);
+        bt_logger->enableBacktrace(8, LogLevel::Value::INFO);
+        gate = gate && bt_logger->shouldLog(LogLevel::Value::INFO) && !bt_logger->shouldLog(LogLevel::Value::DEBUG);
+        std::cout << "backtrace reconfigure while dumping:" << (gate ? " OK" : " FAILED") << std::endl;
+    }
+
+    std::cout << "\n========== 飞行记录仪 ==========\n" << std::endl;
+
+    // 多个写者持续写入时读者反复取快照: 每份快照都应由完整的行组成, 且结尾是最新提交的内容
+    {
+        auto ring = std::make_shared<RingSink>(64 * 1024, "./logs/flight.log");
+        constexpr int kWriters = 4;
+        constexpr int kPerWriter = 50000;
+        std::atomic<bool> done{false};
+        std::vector<std::thread> writers;
+        for (int t = 0; t < kWriters; ++t)
+        {
+            writers.emplace_back([&, t]() {
+                char line[64];
+                for (int i = 0; i < kPerWriter; ++i)
+                {
+                    int n = std::snprintf(line, sizeof(line), "w%d i=%06d ........\n", t, i);
+                    ring->log(line, static_cast<size_t>(n));
+                }
+            });
+        }
+        int snapshots = 0, torn = 0;
+        std::thread reader([&]() {
+            while (!done)
+            {
+                std::string snap = ring->snapshot();
+                ++snapshots;
+                std::stringstream ss(snap);
+                for (std::string line; std::getline(ss, line);)
+                    torn += line.size() != 20 || line[0] != 'w' || line.compare(11, 9, " ........") != 0;
+                torn += !snap.empty() && snap.back() != '\n';
+            }
+        });
+        for (auto &th : writers)
+            th.join();
+        done = true;
+        reader.join();
+
+        // 挂到 logger 上, 主动导出与 SIGUSR1 导出
+        std::vector<LogSink::ptr> sinks{ring};
+        Logger::ptr flight = std::make_shared<SyncLogger>("flight", sinks, LogLevel::Value::DEBUG,
+                                                          std::make_shared<DetailFormat>("flight"));
+        for (int i = 0; i < 5000; ++i)
+            logd(flight, "flight i={}", i);
+        std::string snap = ring->snapshot();
+        bool tail_ok = snap.size() <= ring->capacity() && snap.size() > ring->capacity() / 2
+            && snap.compare(snap.size() - 14, 14, "flight i=4999\n") == 0 && snap.find("flight i=0\n") == std::string::npos;
+        bool dump_ok = ring->dump();
+#ifndef _WIN32
+        util::file::remove("./logs/flight.log");
+        RingSink::dumpOnSignal(SIGUSR1);
+        raise(SIGUSR1);
+        std::ifstream ifs("./logs/flight.log", std::ios::binary);
+        std::string dumped((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        dump_ok = dump_ok && dumped.size() > ring->capacity() / 2 && dumped.back() == '\n'
+            && snap.compare(snap.size() - dumped.size(), dumped.size(), dumped) == 0;
+#endif
+        std::cout << "ring: " << snapshots << " snapshots, torn lines " << torn << ", snapshot " << snap.size()
+                  << " bytes" << (torn == 0 && tail_ok && dump_ok ? " OK" : " FAILED") << std::endl;
+    }
+
+#ifndef _WIN32
+    std::cout << "\n========== 共享内存队列 ==========\n" << std::endl;
+
+    // 应用端只写共享内存, 这里在同一进程内扮演 agent 取出记录; 队列满时丢弃计数, 取走后继续写入
+    {
+        std::string name = "/ylog_test_" + std::to_string(::getpid());
+        ShmRing::unlink(name);
+        auto shm = std::make_shared<ShmSink>(name, 8 * 1024);
+        std::vector<LogSink::ptr> sinks{shm};
+        Logger::ptr producer = std::make_shared<SyncLogger>("shm", sinks, LogLevel::Value::DEBUG,
+                                                            std::make_shared<NormalFormat>());
+        for (int i = 0; i < 100; ++i)
+            logi(producer, "shm i={}", i);
+
+        ShmRing agent;
+        bool attached = agent.attach(name);
+        std::vector<std::string> lines;
+        auto drain = [&]() {
+            return agent.read([&](const char *data, size_t len) { lines.emplace_back(data, len); });
+        };
+        size_t first = attached ? drain() : 0;
+        bool ok = attached && first == 100;
+        for (size_t i = 0; ok && i < lines.size(); ++i)
+            ok = lines[i].size() > 8 && lines[i].compare(lines[i].size() - 8 - std::to_string(i).size(),
+                                                         std::string::npos, " shm i=" + std::to_string(i) + "\n") == 0;
+
+        // 没有人取时写满 8KB 后开始丢弃, 应用不阻塞
+        for (int i = 0; i < 1000; ++i)
+            logi(producer, "shm overflow i={}", i);
+        uint64_t dropped = shm->dropped();
+        const ShmHeader &h = agent.header();
+        ok = ok && dropped > 0 && h.written_records.load() + dropped == 1100;
+
+        // agent 重新连接后接着上次的位置取
+        ShmRing again;
+        lines.clear();
+        size_t second = again.attach(name) ? again.read([&](const char *data, size_t len) { lines.emplace_back(data, len); }) : 0;
+        ok = ok && second + dropped == 1000 && !lines.empty()
+            && lines.front().find("shm overflow i=0\n") != std::string::npos;
+        logi(producer, "shm after drain");
+        ok = ok && drain() == 1 && lines.back().find("shm after drain") != std::string::npos;
+
+        // peek 后未 commit 就退出(模拟 agent 写文件前崩溃), 重新连接的 agent 仍能取到这些记录
+        logi(producer, "shm uncommitted");
+        {
+            ShmRing crashed;
+            ok = ok && crashed.attach(name) && crashed.peek([](const char *, size_t) {}) == 1;
+        }
+        lines.clear();
+        ok = ok && drain() == 1 && lines.back().find("shm uncommitted") != std::string::npos;
+
+        // 应用以不同容量重启: 旧段作废但仍可安全读取, agent 重新连接后看到新容量
+        auto resized = std::make_shared<ShmSink>(name, 16 * 1024);
+        ok = ok && agent.stale() && agent.header().capacity == 8 * 1024 && drain() == 0;
+        resized->log("resized\n", 8);
+        lines.clear();
+        ok = ok && agent.attach(name) && !agent.stale() && agent.header().capacity == 16 * 1024
+            && drain() == 1 && lines.back() == "resized\n";
+        ShmRing::unlink(name);
+        std::cout << "shm: " << first << " + " << second << " records, dropped " << dropped
+                  << (ok ? " OK" : " FAILED") << std::endl;
+    }
+
+
+    std::cout << "\n========== syslog 数据报 ==========\n" << std::endl;
+
+    // 本地套接字扮演收集器: 检查 RFC 5424 头部与等级映射; 收集器关闭后记录丢弃计数且不阻塞
+    {
+        auto parse = [](const std::string &dgram, int &pri, std::string &msg) {
+            size_t gt = dgram.find('>');
+            size_t sd = dgram.find(" - - ");
+            if (dgram.empty() || dgram[0] != '<' || gt == std::string::npos || sd == std::string::npos
+                || dgram.compare(gt, 3, ">1 ") != 0)
+                return false;
+            pri = std::stoi(dgram.substr(1, gt - 1));
+            msg = dgram.substr(sd + 5);
+            return true;
+        };
+
+        // UDP + 异步 logger: 逐条带等级交给 sink, 每批队列一次 sendmmsg
+        int udp = ::socket(AF_INET, SOCK_DGRAM, 0);
+        int rcvbuf = 4 * 1024 * 1024;
+        ::setsockopt(udp, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        sockaddr_in sin{};
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ::bind(udp, reinterpret_cast<sockaddr *>(&sin), sizeof(sin));
+        socklen_t slen = sizeof(sin);
+        ::getsockname(udp, reinterpret_cast<sockaddr *>(&sin), &slen);
+        auto udp_sink = std::make_shared<SyslogSink>("127.0.0.1:" + std::to_string(ntohs(sin.sin_port)), "ylog_test",
+                                                     SyslogSink::kFacilityLocal0);
+        {
+            std::vector<LogSink::ptr> sinks{udp_sink};
+            Logger::ptr net_logger = std::make_shared<AsyncLogger>("syslog", sinks, LogLevel::Value::DEBUG,
+                                                                   std::make_shared<NormalFormat>());
+            for (int i = 0; i < 100; ++i)
+            {
+                if (i % 10 == 9)
+                    logw(net_logger, "syslog i={}", i);
+                else
+                    logi(net_logger, "syslog i={}", i);
+            }
+        }
+        int received = 0, bad = 0;
+        char dgram[16384];
+        for (ssize_t n; (n = ::recv(udp, dgram, sizeof(dgram), MSG_DONTWAIT)) > 0; ++received)
+        {
+            int pri = 0;
+            std::string msg;
+            std::string expect = " syslog i=" + std::to_string(received);
+            int severity = received % 10 == 9 ? 4 : 6;
+            bad += !parse(std::string(dgram, static_cast<size_t>(n)), pri, msg) || pri != 16 * 8 + severity
+                || msg.size() < expect.size() || msg.compare(msg.size() - expect.size(), expect.size(), expect) != 0;
+        }
+        // TIMESTAMP 是记录自己的时间, 不是发送时刻: 交给 sink 一条很早以前的记录
+        auto old_time = std::chrono::system_clock::time_point(std::chrono::seconds(1000000000))
+                        + std::chrono::microseconds(123456);
+        udp_sink->logRecord(RecordView{LogLevel::Value::INFO, old_time, "syslog", "old record", 10});
+        ssize_t old_n = ::recv(udp, dgram, sizeof(dgram), 0);
+        bool old_ok = old_n > 0
+            && std::string(dgram, static_cast<size_t>(old_n)).find(" 2001-09-09T01:46:40.123456Z ") != std::string::npos;
+        ::close(udp);
+        bool ok = received == 100 && bad == 0 && old_ok && udp_sink->sent() == 101 && udp_sink->dropped() == 0;
+
+        // Unix 数据报 + 同步 logger(默认 batch, 每条立即发出); 关闭收集器后继续写, 记录被丢弃且不阻塞
+        std::string path = "./logs/syslog_test.sock";
+        util::file::remove(path);
+        int unix_fd = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+        sockaddr_un sun{};
+        sun.sun_family = AF_UNIX;
+        std::strncpy(sun.sun_path, path.c_str(), sizeof(sun.sun_path) - 1);
+        ::bind(unix_fd, reinterpret_cast<sockaddr *>(&sun), sizeof(sun));
+        auto unix_sink = std::make_shared<SyslogSink>(path, "ylog_test", SyslogSink::kFacilityUser);
+        std::vector<LogSink::ptr> sinks{unix_sink};
+        Logger::ptr local = std::make_shared<SyncLogger>("syslog_local", sinks, LogLevel::Value::DEBUG,
+                                                         std::make_shared<NormalFormat>());
+        loge(local, "collector up");
+        ssize_t n = ::recv(unix_fd, dgram, sizeof(dgram), MSG_DONTWAIT);
+        int pri = 0;
+        std::string msg;
+        ok = ok && n > 0 && parse(std::string(dgram, static_cast<size_t>(n)), pri, msg) && pri == 1 * 8 + 3
+            && msg.find("collector up") != std::string::npos;
+        ::close(unix_fd);
+        util::file::remove(path);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 1000; ++i)
+            logi(local, "collector down i={}", i);
+        auto cost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        ok = ok && unix_sink->sent() == 1 && unix_sink->dropped() == 1000;
+        std::cout << "syslog: udp " << received << " datagrams, unix sent " << unix_sink->sent() << " dropped "
+                  << unix_sink->dropped() << " in " << cost.count() << "ms" << (ok ? " OK" : " FAILED") << std::endl;
+    }
+
+    std::cout << "\n========== TCP 流 ==========\n" << std::endl;
+
+    // 回环地址上的收集器: 中途关闭再在同一端口重启, 断线期间的记录进入 spool, 重连后按顺序补发
+    {
+        auto listenOn = [](uint16_t port) {
+            int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            int one = 1;
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            sockaddr_in sin{};
+            sin.sin_family = AF_INET;
+            sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            sin.sin_port = htons(port);
+            if (::bind(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)) != 0 || ::listen(fd, 4) != 0)
+            {
+                ::close(fd);
+                return -1;
+            }
+            return fd;
+        };
+        std::mutex rx_mutex;
+        std::string received;
+        std::atomic<int> conn_fd{-1};
+        auto serve = [&](int listen_fd) {
+            return std::thread([&, listen_fd]() {
+                int fd = ::accept(listen_fd, nullptr, nullptr);
+                conn_fd = fd;
+                char buf[4096];
+                for (ssize_t n; fd >= 0 && (n = ::recv(fd, buf, sizeof(buf), 0)) > 0;)
+                {
+                    std::unique_lock<std::mutex> lock(rx_mutex);
+                    received.append(buf, static_cast<size_t>(n));
+                }
+            });
+        };
+        auto waitFor = [](const std::function<bool()> &done, int ms) {
+            for (int i = 0; i < ms / 10 && !done(); ++i)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            return done();
+        };
+        auto lineCount = [&]() {
+            std::unique_lock<std::mutex> lock(rx_mutex);
+            return static_cast<int>(std::count(received.begin(), received.end(), '\n'));
+        };
+
+        int listen_fd = listenOn(0);
+        sockaddr_in sin{};
+        socklen_t slen = sizeof(sin);
+        ::getsockname(listen_fd, reinterpret_cast<sockaddr *>(&sin), &slen);
+        uint16_t port = ntohs(sin.sin_port);
+        std::thread collector = serve(listen_fd);
+
+        util::file::remove("./logs/tcp.spool");
+        auto tcp = std::make_shared<TcpSink>("127.0.0.1:" + std::to_string(port), "./logs/tcp.spool");
+        std::vector<LogSink::ptr> sinks{tcp};
+        Logger::ptr streamer = std::make_shared<AsyncLogger>("tcp", sinks, LogLevel::Value::DEBUG,
+                                                             std::make_shared<NormalFormat>());
+        for (int i = 0; i < 100; ++i)
+            logi(streamer, "tcp i={}", i);
+        bool ok = waitFor([&]() { return lineCount() == 100; }, 3000) && tcp->connected();
+
+        // 收集器关闭: 之后的记录写入 spool
+        ::shutdown(conn_fd, SHUT_RDWR);
+        ::close(conn_fd);
+        ::close(listen_fd);
+        collector.join();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        for (int i = 100; i < 200; ++i)
+            logi(streamer, "tcp i={}", i);
+        bool spooled = waitFor([&]() { return tcp->spooled() > 0 && !tcp->connected(); }, 3000);
+        ok = ok && spooled && lineCount() == 100;
+
+        // 同一端口重启, 退避重连后补发
+        listen_fd = listenOn(port);
+        collector = serve(listen_fd);
+        ok = ok && waitFor([&]() { return lineCount() == 200 && tcp->spooled() == 0; }, 5000);
+        std::stringstream ss(received);
+        int expect = 0;
+        for (std::string line; std::getline(ss, line); ++expect)
+        {
+            std::string tail = " tcp i=" + std::to_string(expect);
+            ok = ok && line.size() > tail.size() && line.compare(line.size() - tail.size(), tail.size(), tail) == 0;
+        }
+        streamer.reset();
+        sinks.clear();
+        tcp.reset();
+        ::shutdown(conn_fd, SHUT_RDWR);
+        ::close(conn_fd);
+        ::close(listen_fd);
+        collector.join();
+        std::cout << "tcp newline: " << expect << " lines, spool used " << (spooled ? "yes" : "no")
+                  << (ok ? " OK" : " FAILED") << std::endl;
+
+        // 长度前缀: 4 字节大端长度 + 不带换行的记录
+        received.clear();
+        listen_fd = listenOn(0);
+        slen = sizeof(sin);
+        ::getsockname(listen_fd, reinterpret_cast<sockaddr *>(&sin), &slen);
+        collector = serve(listen_fd);
+        util::file::remove("./logs/tcp_lp.spool");
+        auto lp = std::make_shared<TcpSink>("127.0.0.1:" + std::to_string(ntohs(sin.sin_port)), "./logs/tcp_lp.spool",
+                                            TcpSink::kDefaultSpoolBytes, TcpSink::Framing::LengthPrefix);
+        std::vector<LogSink::ptr> lp_sinks{lp};
+        Logger::ptr framed = std::make_shared<SyncLogger>("tcp_lp", lp_sinks, LogLevel::Value::DEBUG,
+                                                          std::make_shared<NormalFormat>());
+        for (int i = 0; i < 10; ++i)
+            logi(framed, "lp i={}", i);
+        lp->flush();
+        auto frames = [&]() {
+            std::unique_lock<std::mutex> lock(rx_mutex);
+            std::vector<std::string> out;
+            for (size_t pos = 0; pos + 4 <= received.size();)
+            {
+                const unsigned char *p = reinterpret_cast<const unsigned char *>(received.data() + pos);
+                size_t n = (size_t(p[0]) << 24) | (size_t(p[1]) << 16) | (size_t(p[2]) << 8) | size_t(p[3]);
+                if (pos + 4 + n > received.size())
+                    break;
+                out.emplace_back(received, pos + 4, n);
+                pos += 4 + n;
+            }
+            return out;
+        };
+        bool lp_ok = waitFor([&]() { return frames().size() == 10; }, 3000);
+        auto got = frames();
+        for (size_t i = 0; lp_ok && i < got.size(); ++i)
+        {
+            std::string tail = " lp i=" + std::to_string(i);
+            lp_ok = got[i].size() > tail.size() && got[i].compare(got[i].size() - tail.size(), tail.size(), tail) == 0;
+        }
+        framed.reset();
+        lp_sinks.clear();
+        lp.reset();
+        ::shutdown(conn_fd, SHUT_RDWR);
+        ::close(conn_fd);
+        ::close(listen_fd);
+        collector.join();
+        std::cout << "tcp length-prefix: " << got.size() << " frames" << (lp_ok ? " OK" : " FAILED") << std::endl;
+
+        // 上次进程留下的 spool: 中间一帧超过补发的读块(256KB), 末尾是写到一半的残帧.
+        // 补发时大帧整帧发出, 后面的帧边界不乱, 残帧丢弃, 之后的新记录照常发送
+        received.clear();
+        listen_fd = listenOn(0);
+        slen = sizeof(sin);
+        ::getsockname(listen_fd, reinterpret_cast<sockaddr *>(&sin), &slen);
+        collector = serve(listen_fd);
+        auto frameOf = [](const std::string &body) {
+            std::string out(4, '\0');
+            out[0] = static_cast<char>(body.size() >> 24);
+            out[1] = static_cast<char>(body.size() >> 16);
+            out[2] = static_cast<char>(body.size() >> 8);
+            out[3] = static_cast<char>(body.size());
+            return out + body;
+        };
+        std::string big = "big " + std::string(600 * 1024, 'x') + " end";
+        {
+            std::ofstream spool_file("./logs/tcp_big.spool", std::ios::binary | std::ios::trunc);
+            std::string torn = frameOf(std::string(100, 't')).substr(0, 40);
+            std::string content = frameOf("before") + frameOf(big) + frameOf("after") + torn;
+            spool_file.write(content.data(), static_cast<std::streamsize>(content.size()));
+        }
+        auto big_sink = std::make_shared<TcpSink>("127.0.0.1:" + std::to_string(ntohs(sin.sin_port)),
+                                                  "./logs/tcp_big.spool", TcpSink::kDefaultSpoolBytes,
+                                                  TcpSink::Framing::LengthPrefix);
+        big_sink->logRecord(RecordView{LogLevel::Value::INFO, std::chrono::system_clock::now(), "tcp_big", "fresh", 5});
+        big_sink->flush();
+        bool big_ok = waitFor([&]() { return frames().size() == 4 && big_sink->spooled() == 0; }, 5000);
+        got = frames();
+        size_t expect_bytes = 4 * 4 + 6 + big.size() + 5 + 5;
+        big_ok = big_ok && got.size() == 4 && got[0] == "before" && got[1] == big && got[2] == "after"
+            && got[3] == "fresh" && received.size() == expect_bytes && big_sink->dropped() == 1;
+        big_sink.reset();
+        ::shutdown(conn_fd, SHUT_RDWR);
+        ::close(conn_fd);
+        ::close(listen_fd);
+        collector.join();
+        std::cout << "tcp spool replay with a " << big.size() << "-byte frame: " << got.size() << " frames"
+                  << (big_ok ? " OK" : " FAILED") << std::endl;
+    }
+
+    std::cout << "\n========== 控制台 sink ==========\n" << std::endl;
+
+    // 把 fd 1 临时指向文件: 异步批量写出、强制上色、同步立即可见
+    {
+        std::string path = "./logs/console.out";
+        std::fflush(stdout);
+        int saved = ::dup(1);
+        int out = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ::dup2(out, 1);
+        ::close(out);
+        auto plain = std::make_shared<StdoutSink>();
+        bool not_tty = !plain->tty() && !plain->colored();
+        std::string shared_line;
+        {
+            auto colored = std::make_shared<StdoutSink>(ConsoleSink::ColorMode::Always);
+            std::vector<LogSink::ptr> sinks{colored};
+            Logger::ptr console = std::make_shared<AsyncLogger>("console", sinks, LogLevel::Value::DEBUG,
+                                                                std::make_shared<NormalFormat>());
+            for (int i = 0; i < 1000; ++i)
+                logi(console, "console i={}", i);
+            logw(console, "console warn");
+            // 同步 logger 与异步 logger 共用这个 sink: 不受对方批次影响, 立即写出;
+            // 只给格式化器标出的等级字段上色, logger 名称与正文中的等级单词原样保留
+            Logger::ptr shared = std::make_shared<SyncLogger>("WARNINGS", sinks, LogLevel::Value::DEBUG,
+                                                              std::make_shared<DetailFormat>("WARNINGS"));
+            logi(shared, "shared sync ERROR");
+            std::ifstream now(path, std::ios::binary);
+            std::string seen((std::istreambuf_iterator<char>(now)), std::istreambuf_iterator<char>());
+            size_t at = seen.find("shared sync ERROR");
+            size_t begin = seen.rfind('\n', at) + 1;
+            shared_line = at == std::string::npos ? std::string() : seen.substr(begin, seen.find('\n', at) - begin);
+        }
+        std::vector<LogSink::ptr> sync_sinks{plain};
+        Logger::ptr sync_console = std::make_shared<SyncLogger>("console_sync", sync_sinks, LogLevel::Value::DEBUG,
+                                                                std::make_shared<NormalFormat>());
+        logi(sync_console, "console sync");
+        size_t visible = std::filesystem::file_size(path);   // 同步记录不等 flush 就已写出
+        std::fflush(stdout);
+        ::dup2(saved, 1);
+        ::close(saved);
+
+        std::ifstream ifs(path, std::ios::binary);
+        std::vector<std::string> lines;
+        for (std::string line; std::getline(ifs, line);)
+        {
+            if (line.find("console") != std::string::npos && line.find("创建成功") == std::string::npos)
+                lines.push_back(line);
+        }
+        bool ok = not_tty && lines.size() == 1002;
+        for (size_t i = 0; ok && i < 1000; ++i)
+        {
+            std::string tail = " console i=" + std::to_string(i);
+            ok = lines[i].find("\033[32mINFO\033[0m") != std::string::npos && lines[i].size() > tail.size()
+                && lines[i].compare(lines[i].size() - tail.size(), tail.size(), tail) == 0;
+        }
+        ok = ok && lines[1000].find("\033[33mWARN\033[0m") != std::string::npos
+            && lines[1001].find("\033[") == std::string::npos && lines[1001].find("console sync") != std::string::npos
+            && visible == std::filesystem::file_size(path)
+            && shared_line.find("[WARNINGS][\033[32mINFO\033[0m ] shared sync ERROR") != std::string::npos
+            && shared_line.find("\033[33m") == std::string::npos && shared_line.find("\033[31m") == std::string::npos;
+        std::cout << "console: " << lines.size() << " lines, colored async + plain sync" << (ok ? " OK" : " FAILED")
+                  << std::endl;
+    }
+
+    std::cout << "\n========== 按键分文件 ==========\n" << std::endl;
+
+    // 按上下文字段 tenant 分文件: 5 个租户、最多同时打开 2 个文件, 每个文件只含自己租户的记录且顺序不乱
+    {
+        std::filesystem::remove_all("./logs/tenant");
+        auto routing = std::make_shared<RoutingFileSink>("./logs/tenant/{}.log", "tenant", 2,
+                                                         std::chrono::milliseconds(200));
+        {
+            std::vector<LogSink::ptr> sinks{routing};
+            Logger::ptr tenants = std::make_shared<AsyncLogger>("tenants", sinks, LogLevel::Value::DEBUG,
+                                                                std::make_shared<NormalFormat>());
+            std::vector<std::thread> workers;
+            for (int t = 0; t < 5; ++t)
+            {
+                workers.emplace_back([&, t]() {
+                    ScopedContext tenant{"tenant", "t" + std::to_string(t)};
+                    for (int i = 0; i < 2000; ++i)
+                        logi(tenants, "tenant order i={}", i);
+                });
+            }
+            for (auto &th : workers)
+                th.join();
+            logi(tenants, "no tenant");
+            // 带空格的值按原值分文件, 不会截断成同一个前缀; 正文里伪造的字段不影响路由
+            for (const char *name : {"acme corp", "acme labs"})
+            {
+                ScopedContext tenant{"tenant", name};
+                logi(tenants, "order for {}", name);
+            }
+            logi(tenants, "forged tenant=t0 [tenant=t0]");
+        }
+        bool ok = routing->openFiles() <= 2 && routing->opened() >= 5;
+        for (int t = 0; ok && t < 5; ++t)
+        {
+            std::ifstream ifs("./logs/tenant/t" + std::to_string(t) + ".log");
+            int expect = 0;
+            for (std::string line; ok && std::getline(ifs, line); ++expect)
+            {
+                std::string tail = "[tenant=t" + std::to_string(t) + "] tenant order i=" + std::to_string(expect);
+                ok = line.size() > tail.size() && line.compare(line.size() - tail.size(), tail.size(), tail) == 0;
+            }
+            ok = ok && expect == 2000;
+        }
+        auto lines = [](const std::string &path) {
+            std::ifstream ifs(path);
+            std::vector<std::string> out;
+            for (std::string line; std::getline(ifs, line);)
+                out.push_back(line);
+            return out;
+        };
+        auto corp = lines("./logs/tenant/acme_corp.log");
+        auto labs = lines("./logs/tenant/acme_labs.log");
+        auto fallback = lines("./logs/tenant/default.log");
+        ok = ok && corp.size() == 1 && corp[0].find("order for acme corp") != std::string::npos
+            && labs.size() == 1 && labs[0].find("order for acme labs") != std::string::npos
+            && fallback.size() == 2 && fallback[1].find("forged tenant=t0") != std::string::npos;
+
+        // 按 logger 名称分文件(同步, 立即写出); 空闲超时后文件被关闭
+        std::filesystem::remove_all("./logs/route");
+        auto by_name = std::make_shared<RoutingFileSink>("./logs/route/{}.log", "", 8, std::chrono::milliseconds(100));
+        std::vector<LogSink::ptr> name_sinks{by_name};
+        Logger::ptr route_a = std::make_shared<SyncLogger>("route.a", name_sinks, LogLevel::Value::DEBUG,
+                                                           std::make_shared<NormalFormat>());
+        Logger::ptr route_b = std::make_shared<SyncLogger>("route.b", name_sinks, LogLevel::Value::DEBUG,
+                                                           std::make_shared<NormalFormat>());
+        logi(route_a, "to a");
+        logi(route_b, "to b");
+        logi(route_a, "to a again");
+        ok = ok && std::filesystem::file_size("./logs/route/route.a.log") > 0
+            && std::filesystem::file_size("./logs/route/route.b.log") > 0 && by_name->openFiles() == 2;
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        ok = ok && by_name->openFiles() == 0;
+        std::cout << "routing: opened " << routing->opened() << " times with cap 2, idle closed "
+                  << (by_name->openFiles() == 0 ? "yes" : "no") << (ok ? " OK" : " FAILED") << std::endl;
+    }
+#endif
+
+#ifndef _WIN32
+    std::cout << "\n========== 批量写文件 ==========\n" << std::endl;
+
+    // FileSink: 同步记录不等 flush 就已写出; 一批超过 IOV_MAX 条的记录分段 writev, 内容与顺序不变
+    {
+        std::string path = "./logs/batch.log";
+        util::file::remove(path);
+        auto file_sink = std::make_shared<FileSink>(path);
+        std::string head = "sync line\n";
+        file_sink->log(head.data(), head.size());
+        bool ok = std::filesystem::file_size(path) == head.size();
+
+        const size_t count = 3000;
+        std::vector<std::string> lines;
+        for (size_t i = 0; i < count; ++i)
+            lines.push_back("batch i=" + std::to_string(i) + std::string(i % 7, '.') + "\n");
+        std::vector<RecordView> views;
+        std::vector<IoSlice> iov;
+        std::string body;
+        for (auto &line : lines)
+        {
+            views.push_back(RecordView{LogLevel::Value::INFO, std::chrono::system_clock::now(), "batch",
+                                       line.data(), line.size()});
+            iov.push_back(IoSlice{const_cast<char *>(line.data()), line.size()});
+            body += line;
+        }
+        RecordBatch batch{views.data(), iov.data(), count, body.size()};
+        file_sink->deliverBatch(batch);
+        file_sink->flush();
+        std::ifstream ifs(path, std::ios::binary);
+        std::string written((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        ok = ok && written == head + body;
+
+        // writev 被信号打断只写了一部分时, 从断开处接着写: 4KB 的管道配慢速读端, 写线程不断收到信号
+        int fds[2];
+        ok = ok && ::pipe(fds) == 0;
+        ::fcntl(fds[1], F_SETPIPE_SZ, 4096);
+        struct sigaction sa{}, saved{};
+        sa.sa_handler = [](int) {};
+        sigemptyset(&sa.sa_mask);
+        ::sigaction(SIGUSR1, &sa, &saved);       // 不设 SA_RESTART, 阻塞中的 writev 返回已写的字节数
+        std::string piped;
+        std::thread reader([&]() {
+            char chunk[512];
+            ssize_t n;
+            while ((n = ::read(fds[0], chunk, sizeof(chunk))) > 0)
+            {
+                piped.append(chunk, static_cast<size_t>(n));
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+            }
+        });
+        std::atomic<bool> done{false};
+        pthread_t writer = ::pthread_self();
+        std::thread interrupter([&]() {
+            while (!done.load())
+            {
+                ::pthread_kill(writer, SIGUSR1);
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        });
+        detail::writev_fd(fds[1], iov.data(), count);
+        done = true;
+        interrupter.join();
+        ::close(fds[1]);
+        reader.join();
+        ::close(fds[0]);
+        ::sigaction(SIGUSR1, &saved, nullptr);
+        ok = ok && piped == body;
+        std::cout << "file batch: " << count << " records in one writev batch, " << piped.size()
+                  << " bytes through interrupted pipe" << (ok ? " OK" : " FAILED") << std::endl;
+    }
+#endif
+
+    std::cout << "\n========== 层级 logger ==========\n" << std::endl;
+
+    // db.pool.conn 按需创建, 输出到最近的已配置祖先, 等级随祖先变化
+    {
+        util::file::remove("./logs/hier_db.log");
+        util::file::remove("./logs/hier_pool.log");
+        auto &mgr = LoggerMgr::getInstance();
+        std::vector<LogSink::ptr> db_sinks{std::make_shared<FileSink>("./logs/hier_db.log")};
+        mgr.addLogger("db", std::make_shared<SyncLogger>("db", db_sinks, LogLevel::Value::DEBUG,
+                                                        std::make_shared<DetailFormat>("db")));
+
+        auto conn = getLogger("db.pool.conn");
+        logd(conn, "conn opened fd={}", 7);
+        mgr.setLevel("db", LogLevel::Value::WARN);
+        logi(conn, "hidden by db=WARN");
+        logw(conn, "pool exhausted");
+        mgr.setLevel("db.pool", LogLevel::Value::DEBUG);
+        logd(conn, "visible again via db.pool=DEBUG");
+
+        // 之后配置的 db.pool 成为更近的祖先; 先前对 db.pool 设置的 DEBUG 作为规则保留, 优先于构建时的 INFO
+        std::vector<LogSink::ptr> pool_sinks{std::make_shared<FileSink>("./logs/hier_pool.log")};
+        mgr.addLogger("db.pool", std::make_shared<SyncLogger>("db.pool", pool_sinks, LogLevel::Value::INFO,
+                                                             std::make_shared<DetailFormat>("db.pool")));
+        logd(conn, "shown by db.pool=DEBUG rule");
+        logi(conn, "moved to db.pool sinks");
+
+        // 运行期调整: 通配符规则、环境变量同格式的配置串、单个 logger 的 setLevel
+        bool spec_ok = mgr.applyLevelSpec("warn, db.*=error");
+        logw(conn, "hidden by db.*=ERROR");
+        loge(conn, "shown by db.*=ERROR");
+        conn->setLevel(LogLevel::Value::DEBUG);
+        logd(conn, "shown by conn->setLevel(DEBUG)");
+        bool bad_rejected = !mgr.applyLevelSpec("db=verbose");
+        mgr.setLevel("root", LogLevel::Value::DEBUG);
+        db_sinks[0]->flush();
+        pool_sinks[0]->flush();
+
+        auto countLines = [](const char *path, const char *needle) {
+            std::ifstream ifs(path);
+            int n = 0, total = 0;
+            for (std::string line; std::getline(ifs, line); ++total)
+                n += line.find(needle) != std::string::npos;
+            return n == total ? n : -1;
+        };
+        int db_lines = countLines("./logs/hier_db.log", "][db.pool.conn][");
+        int pool_lines = countLines("./logs/hier_pool.log", "][db.pool.conn][");
+        std::cout << "hierarchy: db " << db_lines << ", db.pool " << pool_lines
+                  << (db_lines == 3 && pool_lines == 4 && spec_ok && bad_rejected ? " OK" : " FAILED") << std::endl;
+    }
+
+    std::cout << "\n========== 配置文件与热重载 ==========\n" << std::endl;
+
+    // 改写配置文件后 sink/格式/等级自动切换, 切换过程中异步 logger 的记录不丢失
+    {
+        const char *kFiles[] = {"./logs/cfg_a.log", "./logs/cfg_b.log", "./logs/cfg_async_1.log",
+                                "./logs/cfg_async_2.log", "./logs/cfg_end.log"};
+        for (auto *f : kFiles)
+            util::file::remove(f);
+        auto writeConfig = [](const std::string &text) {
+            // 与多数编辑器一样先写临时文件再改名
+            {
+                std::ofstream ofs("./logs/ylog.ini.tmp");
+                ofs << text;
+            }
+            util::file::rename("./logs/ylog.ini.tmp", "./logs/ylog.ini");
+        };
+        writeConfig("# ylog 配置\n"
+                    "[cfg.sync]\n"
+                    "type = sync\n"
+                    "level = debug\n"
+                    "format = detail\n"
+                    "sinks = file:./logs/cfg_a.log\n"
+                    "\n"
+                    "[cfg.async]\n"
+                    "type = async      ; 后台线程写\n"
+                    "sinks = file:./logs/cfg_async_1.log\n");
+
+        auto &mgr = LoggerMgr::getInstance();
+        bool loaded = mgr.watchConfig("./logs/ylog.ini");
+        auto cfg_sync = getLogger("cfg.sync");
+        auto cfg_async = getLogger("cfg.async");
+        logd(cfg_sync, "before reload");
+
+        constexpr int kLines = 20000;
+        uint64_t gen = mgr.generation();
+        std::thread producer([&]() {
+            for (int i = 0; i < kLines; ++i)
+                logi(cfg_async, "line {}", i);
+        });
+        writeConfig("[cfg.sync]\n"
+                    "level = warn\n"
+                    "format = json\n"
+                    "sinks = file:./logs/cfg_b.log\n"
+                    "[cfg.async]\n"
+                    "type = async\n"
+                    "sinks = file:./logs/cfg_async_2.log\n");
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+        while (mgr.generation() == gen && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        bool reloaded = mgr.generation() != gen;
+        producer.join();
+        logi(cfg_sync, "hidden by level=warn");
+        logw(cfg_sync, "after reload");
+
+        // 有错误的配置整份不生效
+        {
+            std::ofstream ofs("./logs/ylog_bad.ini");
+            ofs << "[cfg.sync]\nsinks = file:./logs/cfg_end.log\n[cfg.async]\nsinks = tcp:127.0.0.1:514\n";
+        }
+        bool bad_rejected = !mgr.loadConfig("./logs/ylog_bad.ini") && !util::file::exists("./logs/cfg_end.log");
+        mgr.unwatchConfig();
+
+        auto countLines = [](const char *path) {
+            std::ifstream ifs(path);
+            int n = 0;
+            for (std::string line; std::getline(ifs, line);)
+                ++n;
+            return n;
+        };
+        int async_total = 0;
+        deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+        do
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            async_total = countLines("./logs/cfg_async_1.log") + countLines("./logs/cfg_async_2.log");
+        } while (async_total < kLines && std::chrono::steady_clock::now() < deadline);
+
+        // 再切走一次让 cfg_b.log 被 flush
+        writeConfig("[cfg.sync]\nsinks = file:./logs/cfg_end.log\n");
+        mgr.loadConfig("./logs/ylog.ini");
+        std::ifstream ifs("./logs/cfg_b.log");
+        std::string json_line;
+        std::getline(ifs, json_line);
+        bool json_ok = json_line.find("\"msg\":\"after reload\"") != std::string::npos && countLines("./logs/cfg_b.log") == 1;
+        bool ok = loaded && reloaded && bad_rejected && json_ok && countLines("./logs/cfg_a.log") == 1
+            && async_total == kLines;
+        std::cout << "config: reloaded " << reloaded << ", async lines " << async_total << " ("
+                  << countLines("./logs/cfg_async_1.log") << " + " << countLines("./logs/cfg_async_2.log") << ")"
+                  << (ok ? " OK" : " FAILED") << std::endl;
+    }
+
+    // 队列占满、生产者在 pushWith 中等待时反复热重载: 等待中的生产者拿着的格式化器不被回收,
+    // 生产者都返回后旧快照才在之后的重载中释放
+    {
+        struct GateSink : public LogSink {
+            std::mutex mutex;
+            std::condition_variable cv;
+            bool open = false;
+            std::atomic<size_t> lines{0};
+
+            void wait()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this]() { return open; });
+            }
+            void log(const char *, size_t) override
+            {
+                wait();
+                lines.fetch_add(1);
+            }
+            void logBatch(const RecordBatch &batch) override
+            {
+                wait();
+                lines.fetch_add(batch.count);
+            }
+            void release()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                open = true;
+                cv.notify_all();
+            }
+        };
+        // 析构时标记, 析构之后仍被调用则计数
+        struct TrackingFormat : public LoggerFormat {
+            TrackingFormat(std::atomic<bool> *freed, std::atomic<int> *late) : _freed(freed), _late(late) {}
+            ~TrackingFormat() override { _freed->store(true); }
+            std::string formatLog(LogLevel::Value, const std::string &msg) override { return msg + "\n"; }
+            size_t formatTo(char *out, size_t cap, const LogMsg &msg) override
+            {
+                if (_freed->load())
+                    _late->fetch_add(1);
+                std::string line = fmt::vformat(msg.fmt, msg.args) + "\n";
+                std::memcpy(out, line.data(), std::min(line.size(), cap));
+                return line.size();
+            }
+            std::atomic<bool> *_freed;
+            std::atomic<int> *_late;
+        };
+
+        constexpr int kFormats = 5;
+        constexpr int kProducers = 4;
+        constexpr int kPerProducer = 2000;
+        std::atomic<bool> freed[kFormats] = {};
+        std::atomic<int> late{0};
+        auto format = [&](int i) { return std::make_shared<TrackingFormat>(&freed[i], &late); };
+        auto gate = std::make_shared<GateSink>();
+        std::vector<LogSink::ptr> gate_sinks{gate};
+        auto stall = std::make_shared<AsyncLogger>("reload_stall", gate_sinks, LogLevel::Value::DEBUG, format(0));
+
+        // 后台线程卡在第一批, 生产者拿着第二份快照把队列写满后等待
+        logi(stall, "first");
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        stall->reconfigure(format(1), gate_sinks);
+        std::atomic<int> returned{0};
+        const std::string pad(1024, 'p');
+        std::vector<std::thread> producers;
+        for (int t = 0; t < kProducers; ++t)
+        {
+            producers.emplace_back([&]() {
+                for (int i = 0; i < kPerProducer; ++i)
+                    logi(stall, "stalled i={} {}", i, pad);
+                returned.fetch_add(1);
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        bool blocked = returned.load() == 0;
+        // 两次重载相隔超过 1 秒, 第二份快照此时仍被等待中的生产者使用
+        stall->reconfigure(format(2), gate_sinks);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+        stall->reconfigure(format(3), gate_sinks);
+        bool kept = !freed[1].load();
+        gate->release();
+        for (auto &th : producers)
+            th.join();
+
+        size_t expect = 1 + kProducers * kPerProducer;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (gate->lines.load() < expect && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        stall->reconfigure(format(4), gate_sinks);
+        bool reclaimed = freed[0].load() && freed[1].load() && freed[2].load() && !freed[3].load() && !freed[4].load();
+        bool ok = blocked && kept && late.load() == 0 && gate->lines.load() == expect && reclaimed;
+        std::cout << "reload under backpressure: blocked " << blocked << ", kept " << kept << ", late "
+                  << late.load() << ", lines " << gate->lines.load() << ", reclaimed " << reclaimed
+                  << (ok ? " OK" : " FAILED") << std::endl;
+    }
+
+    std::cout << "\n========== getLogger 查找 ==========\n" << std::endl;
+
+    // 多线程反复按名称查找(含首次创建), 之后注册同名 logger 时缓存失效
+    {
+        auto &mgr = LoggerMgr::getInstance();
+        constexpr int kThreads = 8;
+        constexpr int kLookups = 1000000;
+        constexpr int kNames = 32;
+        std::vector<std::string> names;
+        for (int i = 0; i < kNames; ++i)
+            names.push_back("lookup.n" + std::to_string(i));
+
+        // 各线程同时第一次查找, 必须得到同一个子 logger
+        std::vector<std::vector<Logger *>> seen(kThreads);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < kThreads; ++t)
+        {
+            threads.emplace_back([&, t]() {
+                for (auto &name : names)
+                    seen[t].push_back(getLogger(name).get());
+            });
+        }
+        for (auto &th : threads)
+            th.join();
+        threads.clear();
+        int mismatches = 0;
+        for (int t = 0; t < kThreads; ++t)
+            for (int i = 0; i < kNames; ++i)
+                mismatches += seen[t][i] != seen[0][i] || seen[t][i]->loggerName() != names[i];
+
+        std::atomic<int> misses{0};
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < kThreads; ++t)
+        {
+            threads.emplace_back([&, t]() {
+                // 每个线程只用 4 个名称, 与热点函数反复查同一个 logger 的情形一致
+                for (int i = 0; i < kLookups; ++i)
+                {
+                    int idx = (t * 4 + i % 4) % kNames;
+                    if (getLogger(names[idx]).get() != seen[0][idx])
+                        ++misses;
+                }
+            });
+        }
+        for (auto &th : threads)
+            th.join();
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        mismatches += misses;
+
+        auto before = getLogger("lookup.n0");
+        bool stable = getLogger("lookup.n0") == before;
+        std::vector<LogSink::ptr> sinks{std::make_shared<StdoutSink>()};
+        auto configured = std::make_shared<SyncLogger>("lookup.n0", sinks, LogLevel::Value::DEBUG,
+                                                       std::make_shared<NormalFormat>());
+        mgr.addLogger("lookup.n0", configured);
+        bool replaced = getLogger("lookup.n0") == configured && mgr.hasLogger("lookup.n31");
+
+        // 读者不停查快照(hasLogger)时反复注册: 每次注册后立即可见, root 的取用不经过锁
+        threads.clear();
+        std::atomic<bool> stop{false};
+        std::atomic<long> reads{0};
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&]() {
+                while (!stop.load())
+                {
+                    reads += mgr.hasLogger("lookup.n31") && rootLogger() == mgr.rootLogger();
+                }
+            });
+        }
+        while (reads.load() == 0)
+            std::this_thread::yield();
+        int invisible = 0;
+        for (int i = 0; i < 64; ++i)
+        {
+            std::string name = "lookup.reg" + std::to_string(i);
+            std::vector<LogSink::ptr> reg_sinks{std::make_shared<StdoutSink>()};
+            mgr.addLogger(name, std::make_shared<SyncLogger>(name, reg_sinks, LogLevel::Value::OFF,
+                                                             std::make_shared<NormalFormat>()));
+            invisible += !mgr.hasLogger(name);
+        }
+        stop = true;
+        for (auto &th : threads)
+            th.join();
+        replaced = replaced && invisible == 0;
+
+        std::cout << "getLogger: " << static_cast<long>(secs * 1e9 / (static_cast<double>(kThreads) * kLookups))
+                  << " ns/op x " << kThreads << " threads"
+                  << (mismatches == 0 && stable && replaced ? " OK" : " FAILED") << std::endl;
+    }
+
+    std::cout << "\n========== 字符转义 ==========\n" << std::endl;
+
+    // 用户输入里的换行/控制字符不能拆开一条记录; JSON 中按规范转义
+    {
+        for (auto format : {LoggerFormat::FormatType::FORMAT_DETAIL, LoggerFormat::FormatType::FORMAT_JSON})
+        {
+            LoggerBuilder esc_builder;
+            esc_builder.buildLoggerName("escape");
+            esc_builder.buildLoggerType(Logger::Type::LOGGER_SYNC);
+            esc_builder.buildLoggerFormat(format);
+            esc_builder.buildSink<StdoutSink>();
+            auto esc_logger = esc_builder.build();
+            logw(esc_logger, "login failed: user={}", "bob\nINFO fake record\r\x1b[31m\t\"x\"");
+        }
+
+        // 扫描吞吐: 干净文本 / 每 16 字节一个需转义字符, 对比逐字节扫描
+        constexpr size_t kSize = 1 << 20;
+        constexpr int kRounds = 200;
+        std::string clean(kSize, 'a');
+        std::string dirty(kSize, 'a');
+        for (size_t i = 15; i < kSize; i += 16)
+            dirty[i] = '"';
+        fmt::memory_buffer out;
+        for (auto *input : {&clean, &dirty})
+        {
+            const char *name = input == &clean ? "clean" : "dirty";
+            const char *begin = input->data();
+            const char *end = begin + input->size();
+
+            size_t hits = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < kRounds; ++r)
+                for (const char *p = begin; (p = simd::scanScalar<0x20, '"', '\\'>(p, end)) != end; ++p)
+                    ++hits;
+            double scalar = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            start = std::chrono::steady_clock::now();
+            for (int r = 0; r < kRounds; ++r)
+                for (const char *p = begin; (p = simd::findJson(p, end)) != end; ++p)
+                    ++hits;
+            double vector = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            start = std::chrono::steady_clock::now();
+            for (int r = 0; r < kRounds; ++r)
+            {
+                out.clear();
+                MemoryWriter w(out);
+                encode::jsonEscape(w, fmt::string_view(begin, input->size()));
+            }
+            double escape = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            double mb = static_cast<double>(kSize) * kRounds / (1 << 20);
+            std::cout << name << ": scan scalar " << static_cast<long>(mb / scalar) << " MB/s, simd "
+                      << static_cast<long>(mb / vector) << " MB/s, jsonEscape "
+                      << static_cast<long>(mb / escape) << " MB/s (hits " << hits / 2 / kRounds << ")" << std::endl;
+        }
+    }
+
+    std::cout << "\n========== 模式格式化 ==========\n" << std::endl;
+
+    {
+        LoggerBuilder pattern_builder;
+        pattern_builder.buildLoggerName("pattern");
+        pattern_builder.buildLoggerType(Logger::Type::LOGGER_SYNC);
+        pattern_builder.buildLoggerPattern("%Y-%m-%d %H:%M:%S.%e [%l] %n(%t): %v 100%%");
+        pattern_builder.buildSink<StdoutSink>();
+        auto pattern_logger = pattern_builder.build();
+        logi(pattern_logger, "模式格式化: value = {}", 42);
+
+        // %t/%T: 异步 logger 记录的是调用方线程, 不是后台线程
+        util::file::remove("./logs/thread_tag.log");
+        LoggerBuilder tag_builder;
+        tag_builder.buildLoggerName("thread_tag");
+        tag_builder.buildLoggerType(Logger::Type::LOGGER_ASYNC);
+        tag_builder.buildLoggerPattern("[%t][%T] %v");
+        tag_builder.buildSink<FileSink>("./logs/thread_tag.log");
+        auto tag_logger = tag_builder.build();
+        std::string worker_tid;
+        std::thread worker([&]() {
+            util::thread::setName("ylog-worker");
+            worker_tid = util::thread::tag().id;
+            logi(tag_logger, "from worker");
+        });
+        worker.join();
+        logi(tag_logger, "from main");
+        tag_logger.reset();
+
+        std::ifstream tag_ifs("./logs/thread_tag.log");
+        std::string worker_line, main_line;
+        std::getline(tag_ifs, worker_line);
+        std::getline(tag_ifs, main_line);
+        std::string main_prefix = "[" + util::thread::tag().id + "][" + util::thread::tag().name + "] ";
+        bool tag_ok = worker_line == "[" + worker_tid + "][ylog-worker] from worker"
+            && main_line == main_prefix + "from main" && worker_tid != util::thread::tag().id;
+        std::cout << worker_line << "\n" << main_line << (tag_ok ? "\nthread tag OK" : "\nthread tag FAILED") << std::endl;
+
+        // 调用点: 文件名、行号、函数名在编译期准备好
+        util::file::remove("./logs/source.log");
+        std::vector<LogSink::ptr> src_sinks{std::make_shared<FileSink>("./logs/source.log")};
+        Logger::ptr src_logger = std::make_shared<SyncLogger>("source", src_sinks, LogLevel::Value::INFO,
+                                                              std::make_shared<PatternFormat>("source", "[%s:%#][%!] %v"));
+        int src_line = __LINE__ + 1;
+        YLOG_INFO(src_logger, "with source {}", 1);
+        YLOG_DEBUG(src_logger, "filtered {}", src_line);
+        YLOG_WARN(src_logger, "fields", kv("k", 2));
+        src_logger->info("without source");
+        src_sinks[0]->flush();
+
+        std::ifstream src_ifs("./logs/source.log");
+        std::vector<std::string> src_lines;
+        for (std::string line; std::getline(src_ifs, line);)
+            src_lines.push_back(line);
+        std::string loc = "[test.cpp:" + std::to_string(src_line);
+        bool src_ok = src_lines.size() == 3 && src_lines[0] == loc + "][main] with source 1"
+            && src_lines[1] == "[test.cpp:" + std::to_string(src_line + 2) + "][main] fields k=2"
+            && src_lines[2] == "[:][] without source";
+        for (auto &line : src_lines)
+            std::cout << line << std::endl;
+        std::cout << "source location " << (src_ok ? "OK" : "FAILED") << std::endl;
+
+        // 旧接口 formatLog: 各格式化器共用 LoggerFormat::formatVia, 输出与 formatTo 一致
+        std::string legacy_pattern = PatternFormat("legacy", "[%n][%l] %v").formatLog(LogLevel::Value::WARN, "old api");
+        std::string legacy_json = JsonFormat("legacy").formatLog(LogLevel::Value::INFO, "old \"api\"");
+        std::string legacy_logfmt = LogfmtFormat("legacy").formatLog(LogLevel::Value::ERROR, "old api");
+        bool legacy_ok = legacy_pattern == "[legacy][WARN ] old api\n"
+            && legacy_json.find(R"("level":"INFO","logger":"legacy","msg":"old \"api\"")") != std::string::npos
+            && legacy_logfmt.find(R"( level=error logger=legacy msg="old api")") != std::string::npos;
+        std::cout << "legacy formatLog " << (legacy_ok ? "OK" : "FAILED") << std::endl;
+
+        // 同一条日志分别用 DetailFormat / PatternFormat / StaticPatternFormat 格式化到栈上缓冲区
+        constexpr int kIters = 1000000;
+        std::vector<LoggerFormat::ptr> formats = {
+            std::make_shared<DetailFormat>("bench"),
+            std::make_shared<PatternFormat>("bench", kDetailPattern),
+            std::make_shared<StaticPatternFormat<kDetailPattern>>("bench"),
+        };
+        const char *names[] = {"DetailFormat", "PatternFormat", "StaticPatternFormat"};
+        char line[256];
+        for (size_t f = 0; f < formats.size(); ++f)
+        {
+            int i = 0;
+            auto store = fmt::make_format_args(i);
+            LogMsg msg{LogLevel::Value::INFO, {}, "i={}, msg=hello", store};
+            size_t total = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (; i < kIters; ++i)
+            {
+                msg.time = std::chrono::system_clock::now();
+                total += formats[f]->formatTo(line, sizeof(line), msg);
+            }
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / kIters;
+            std::cout << names[f] << ": " << ns << " ns/line (" << total / kIters << " bytes)" << std::endl;
+        }
+    }
+
+    std::cout << "\n========== 多队列归并压测 ==========\n" << std::endl;
+
+    // 对比单队列 AsyncWorker 与按线程分队列 + 时间归并, 计时包含后台排空(logger 析构)
+    {
+        constexpr int kTotal = 200000;
+        for (size_t lanes : {size_t(1), size_t(8)})
+        {
+            for (int nthreads : {1, 8, 32})
+            {
+                auto start = std::chrono::steady_clock::now();
+                {
+                    LoggerBuilder bench_builder;
+                    bench_builder.buildLoggerName("bench_lanes");
+                    bench_builder.buildLoggerType(Logger::Type::LOGGER_ASYNC);
+                    bench_builder.buildAsyncLanes(lanes);
+                    bench_builder.buildLoggerFormat(LoggerFormat::FormatType::FORMAT_DETAIL);
+                    bench_builder.buildSink<FileSink>("./logs/bench_lanes.log");
+                    auto bench_logger = bench_builder.build();
+
+                    std::vector<std::thread> threads;
+                    for (int t = 0; t < nthreads; ++t)
+                    {
+                        threads.emplace_back([bench_logger, t, nthreads]() {
+                            for (int i = 0; i < kTotal / nthreads; ++i)
+                                logi(bench_logger, "tid={}, i={}, msg={}", t, i, "hello");
+                        });
+                    }
+                    for (auto &th : threads)
+                        th.join();
+                }
+                double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                std::cout << "lanes=" << lanes << " threads=" << nthreads
+                          << " lines/s=" << static_cast<long>(kTotal / sec) << std::endl;
+            }
+        }
+    }
+
     std::cout << "\n========== 测试完成 ==========\n" << std::endl;
 
     return 0;
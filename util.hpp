@@ -9,6 +9,25 @@
 #include <cstdint>
 #include <cassert>
 #include <filesystem>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _WIN32
+// 只用到 GetCurrentThreadId, 自行声明而不包含 <windows.h>: 公共头文件不把 min/max 等宏和整套
+// Win32 声明带给使用方. 与 <windows.h> 中的声明(DWORD WINAPI, dllimport)一致, 两者可以同时出现
+extern "C" __declspec(dllimport) unsigned long __stdcall GetCurrentThreadId(void);
+#else
+#include <pthread.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+#endif
 
 // Note: This project targets C++17. For path and filesystem operations,
 // prefer std::filesystem over platform-specific syscalls.
@@ -131,6 +150,288 @@ namespace YLog
                 return !ec;
             }
         };
+
+        class thread {
+        public:
+            // 当前线程的系统线程号, 每个线程只在第一次调用时查询
+            static uint64_t id()
+            {
+                return tag().tid;
+            }
+
+            // 日志里使用的线程标识: 线程号的十进制文本与线程名, 在线程第一次写日志时生成,
+            // 之后每条日志只拷贝字节. 没有名称的线程用线程号代替.
+            struct Tag {
+                uint64_t tid;
+                std::string id;
+                std::string name;
+                unsigned forks;     // 生成时的 fork 次数, fork 后子进程里的线程号会变
+            };
+
+            static const Tag &tag()
+            {
+                return current();
+            }
+
+            // 设置当前线程的名称(系统名称与日志中 %T 的输出). Linux 上系统名称最多 15 字节
+            static void setName(const std::string &name)
+            {
+#if defined(__linux__)
+                ::pthread_setname_np(::pthread_self(), name.substr(0, 15).c_str());
+#elif defined(__APPLE__)
+                ::pthread_setname_np(name.substr(0, 63).c_str());
+#endif
+                Tag &tag = current();
+                tag.name = name.empty() ? tag.id : name;
+            }
+
+        private:
+            static Tag &current()
+            {
+                thread_local Tag tag = queryTag();
+                if (tag.forks != forkCount().load(std::memory_order_relaxed))
+                {
+                    std::string name = tag.name != tag.id ? tag.name : std::string();
+                    tag = queryTag();
+                    if (!name.empty())
+                        tag.name = name;
+                }
+                return tag;
+            }
+
+            static std::atomic<unsigned> &forkCount()
+            {
+                static std::atomic<unsigned> count{0};
+#ifndef _WIN32
+                static bool registered = (::pthread_atfork(nullptr, nullptr, []() {
+                    forkCount().fetch_add(1, std::memory_order_relaxed);
+                }), true);
+                (void)registered;
+#endif
+                return count;
+            }
+
+            static Tag queryTag()
+            {
+                Tag tag;
+                tag.forks = forkCount().load(std::memory_order_relaxed);
+                tag.tid = query_id();
+                tag.id = std::to_string(tag.tid);
+#if defined(__linux__) || defined(__APPLE__)
+                char buf[64] = {0};
+                if (::pthread_getname_np(::pthread_self(), buf, sizeof(buf)) == 0)
+                {
+                    tag.name = buf;
+                }
+#endif
+                if (tag.name.empty())
+                {
+                    tag.name = tag.id;
+                }
+                return tag;
+            }
+
+            static uint64_t query_id()
+            {
+#ifdef _WIN32
+                return static_cast<uint64_t>(::GetCurrentThreadId());
+#elif defined(__linux__)
+                return static_cast<uint64_t>(::syscall(SYS_gettid));
+#else
+                return static_cast<uint64_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+#endif
+            }
+        };
+
+        // 基于纪元的延迟回收, 用于读路径无锁、写者整体替换的只读快照.
+        // 读者在 Guard 期间把进入时的全局纪元登记在本线程的槽里(每个线程独占一个缓存行, 读者之间
+        // 不争用同一个计数); 写者替换共享指针后调用 advance() 得到旧快照的纪元, 之后 idle() 为
+        // true 时已没有线程可能持有它, 可以释放. Guard 可以嵌套, 只有最外层登记.
+        // 共享指针的读写与槽的读写都要用 seq_cst, 先后关系依赖它.
+        class epoch {
+        private:
+            // 槽串成只增不减的无锁链表, 线程退出后留给新线程复用
+            struct alignas(64) Slot {
+                std::atomic<uint64_t> entered{0};   // 0 表示不在读
+                std::atomic<bool> used{true};
+                unsigned depth = 0;
+                Slot *next = nullptr;
+            };
+
+        public:
+            class Guard {
+            public:
+                Guard() : _slot(slot())
+                {
+                    if (_slot.depth++ == 0)
+                        _slot.entered.store(global().load());
+                }
+                ~Guard()
+                {
+                    if (--_slot.depth == 0)
+                        _slot.entered.store(0, std::memory_order_release);
+                }
+                Guard(const Guard &) = delete;
+                Guard &operator=(const Guard &) = delete;
+
+            private:
+                Slot &_slot;
+            };
+
+            // 替换共享指针之后调用, 返回被替换对象的纪元
+            static uint64_t advance()
+            {
+                return global().fetch_add(1);
+            }
+
+            // 没有读者停留在 retired 或更早的纪元
+            static bool idle(uint64_t retired)
+            {
+                for (Slot *s = head().load(); s; s = s->next)
+                {
+                    uint64_t e = s->entered.load();
+                    if (e != 0 && e <= retired)
+                        return false;
+                }
+                return true;
+            }
+
+        private:
+            static std::atomic<uint64_t> &global()
+            {
+                static std::atomic<uint64_t> e{1};
+                return e;
+            }
+
+            static std::atomic<Slot *> &head()
+            {
+                static std::atomic<Slot *> h{nullptr};
+#ifndef _WIN32
+                // 其他线程不会进入 fork 出的子进程, 子进程里归还它们的槽
+                static bool registered = (::pthread_atfork(nullptr, nullptr, []() {
+                    for (Slot *s = head().load(); s; s = s->next)
+                    {
+                        if (s != self())
+                        {
+                            s->entered.store(0);
+                            s->depth = 0;
+                            s->used.store(false);
+                        }
+                    }
+                }), true);
+                (void)registered;
+#endif
+                return h;
+            }
+
+            static Slot *&self()
+            {
+                thread_local Slot *s = nullptr;
+                return s;
+            }
+
+            static Slot &slot()
+            {
+                Slot *&s = self();
+                if (s == nullptr)
+                    s = acquire();
+                return *s;
+            }
+
+            static Slot *acquire()
+            {
+                Slot *found = nullptr;
+                for (Slot *s = head().load(); s && !found; s = s->next)
+                {
+                    bool expected = false;
+                    if (!s->used.load() && s->used.compare_exchange_strong(expected, true))
+                        found = s;
+                }
+                if (!found)
+                {
+                    found = new Slot();
+                    found->next = head().load();
+                    while (!head().compare_exchange_weak(found->next, found))
+                    {
+                    }
+                }
+                // 线程退出时归还. 退出清理中(其他 thread_local 析构时)才第一次用到的槽不再归还
+                struct Release {
+                    ~Release()
+                    {
+                        exiting() = true;
+                        self()->used.store(false);
+                        self() = nullptr;
+                    }
+                };
+                if (!exiting())
+                {
+                    thread_local Release release;
+                    (void)release;
+                }
+                return found;
+            }
+
+            static bool &exiting()
+            {
+                thread_local bool e = false;
+                return e;
+            }
+        };
+
+        class string {
+        public:
+            // 通配符匹配: * 匹配任意多个字符(包括 '.'), ? 匹配一个字符
+            static bool globMatch(const std::string &pattern, const std::string &text)
+            {
+                size_t p = 0, t = 0;
+                size_t star = std::string::npos, mark = 0;
+                while (t < text.size())
+                {
+                    if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t]))
+                    {
+                        ++p;
+                        ++t;
+                    }
+                    else if (p < pattern.size() && pattern[p] == '*')
+                    {
+                        star = p++;
+                        mark = t;
+                    }
+                    else if (star != std::string::npos)
+                    {
+                        p = star + 1;
+                        t = ++mark;
+                    }
+                    else
+                    {
+                        return false;
+                    }
+                }
+                while (p < pattern.size() && pattern[p] == '*')
+                    ++p;
+                return p == pattern.size();
+            }
+
+            static std::string trim(const std::string &s)
+            {
+                size_t b = s.find_first_not_of(" \t\r\n");
+                if (b == std::string::npos)
+                    return std::string();
+                size_t e = s.find_last_not_of(" \t\r\n");
+                return s.substr(b, e - b + 1);
+            }
+
+            // 返回与 s 内容相同、在进程内常驻的字符串视图, 同样的内容只保存一份.
+            // 用于随异步记录保存的 logger 名称, logger 销毁后队列中的记录仍可引用
+            static std::string_view intern(const std::string &s)
+            {
+                static std::mutex mutex;
+                static auto *pool = new std::unordered_set<std::string>();
+                std::unique_lock<std::mutex> lock(mutex);
+                return *pool->insert(s).first;
+            }
+        };
     }
 }
 
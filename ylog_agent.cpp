@@ -0,0 +1,101 @@
+// ylog_agent: 从应用的共享内存队列(ShmSink)取出日志, 经 RollSink 写入文件.
+//
+//   ylog_agent <共享内存名> <文件前缀> [单个文件最大字节数, 默认 100MB]
+//   ylog_agent /ylog_app ./logs/app.log 104857600
+//
+// 队列不存在时每秒重试; 应用端在 agent 退出期间只丢弃不阻塞, agent 重启后从上次的位置继续.
+// 收到 SIGINT/SIGTERM 时取完剩余记录再退出.
+
+#include "shm.hpp"
+#include "sink.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace YLog;
+
+static std::atomic<bool> g_running{true};
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "usage: " << argv[0] << " <shm-name> <roll-basename> [max-file-bytes]\n";
+        return 2;
+    }
+    std::string name = argv[1];
+    std::string basename = argv[2];
+    size_t max_size = argc > 3 ? static_cast<size_t>(std::strtoull(argv[3], nullptr, 10)) : 100 * 1024 * 1024;
+
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = [](int) { g_running = false; };
+    sigemptyset(&sa.sa_mask);
+    ::sigaction(SIGINT, &sa, nullptr);
+    ::sigaction(SIGTERM, &sa, nullptr);
+
+    ShmRing ring;
+    auto attach = [&]() {
+        while (!ring.attach(name))
+        {
+            if (!g_running)
+                return false;
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+        std::cerr << "ylog_agent: attached to " << name << ", capacity " << ring.header().capacity << " bytes\n";
+        return true;
+    };
+    if (!attach())
+        return 0;
+
+    RollSink sink(basename, max_size);
+    uint64_t reported = ring.header().dropped_records.load(std::memory_order_relaxed);
+    auto idle = std::chrono::milliseconds(1);
+    while (true)
+    {
+        bool running = g_running;
+        // 应用以新容量重启时旧段被作废: 取完旧段剩下的记录后连接新段
+        bool stale = ring.stale();
+        // 写入文件并 fdatasync 之后才推进 tail: agent 崩溃或机器掉电时, 未同步到磁盘的记录仍留在队列里
+        size_t n = ring.peek([&](const char *data, size_t len) { sink.log(data, len); });
+        if (n > 0)
+        {
+            sink.sync();
+            idle = std::chrono::milliseconds(1);
+        }
+        ring.commit();
+        if (stale)
+        {
+            std::cerr << "ylog_agent: " << name << " was recreated by the application, reattaching\n";
+            if (!attach())
+                break;
+            reported = ring.header().dropped_records.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (n == 0)
+        {
+            if (!running)
+                break;
+            // 空闲时逐步拉长轮询间隔, 最长 50ms
+            std::this_thread::sleep_for(idle);
+            idle = std::min(idle * 2, std::chrono::milliseconds(50));
+        }
+
+        uint64_t dropped = ring.header().dropped_records.load(std::memory_order_relaxed);
+        if (dropped != reported)
+        {
+            std::cerr << "ylog_agent: " << dropped - reported << " records dropped by the application (total "
+                      << dropped << ")\n";
+            reported = dropped;
+        }
+    }
+    sink.sync();
+    return 0;
+}